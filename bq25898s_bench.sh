@@ -0,0 +1,125 @@
+#!/bin/sh
+#
+# Bus cost per driver operation, measured against the chip model
+#
+# Loads bq25898s_emul.ko and bq25898s_slave.ko, plugs and unplugs the
+# modelled adapter, pulses INT, lets the monitor run and reads the register
+# dump from several readers at once, then compares the transfers and bytes
+# per operation in op_stats against a baseline. Wall time depends on the
+# machine and is reported only.
+#
+# usage: bq25898s_bench.sh [-b baseline] [-t threshold%] [-u] [emul.ko slave.ko]
+#	-u	write the measured costs to the baseline instead of comparing
+#
+# Needs root and debugfs mounted on /sys/kernel/debug. Build both modules
+# with "make -C <kernel> M=$PWD" first.
+
+set -e
+
+baseline=$(dirname "$0")/bq25898s_bench.baseline
+threshold=10
+update=0
+cycles=5
+readers=4
+
+while getopts b:t:u opt; do
+	case $opt in
+	b) baseline=$OPTARG ;;
+	t) threshold=$OPTARG ;;
+	u) update=1 ;;
+	*) sed -n 's/^# usage: /usage: /p' "$0"; exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+emul_ko=${1:-bq25898s_emul.ko}
+slave_ko=${2:-bq25898s_slave.ko}
+debugfs=/sys/kernel/debug
+
+cleanup() {
+	rmmod bq25898s_slave 2>/dev/null || true
+	rmmod bq25898s_emul 2>/dev/null || true
+}
+trap cleanup EXIT
+
+cleanup
+insmod "$emul_ko"
+insmod "$slave_ko"
+
+emul=$(ls -d $debugfs/bq25898s-emul.* | head -n 1)
+nr=${emul##*.}
+drv=$debugfs/bq25898s-$nr-006b
+dev=/sys/bus/i2c/devices/$nr-006b
+
+if [ ! -d "$drv" ]; then
+	echo "driver did not bind to the chip model on i2c-$nr" >&2
+	exit 1
+fi
+
+echo 5000 > "$emul/vbus"
+i=0
+while [ $i -lt $cycles ]; do
+	echo 1 > "$drv/adapter"
+	echo 1 > "$emul/int"
+	j=0
+	while [ $j -lt $readers ]; do
+		cat "$dev/registers" > /dev/null &
+		j=$((j + 1))
+	done
+	wait
+	echo 0 > "$drv/adapter"
+	i=$((i + 1))
+done
+
+# a few monitor periods while charging
+echo 1 > "$drv/adapter"
+sleep 25
+echo 0 > "$drv/adapter"
+
+stats=$(mktemp)
+cat "$drv/op_stats" > "$stats"
+cat "$stats"
+
+# per operation: xfers and bytes per run, wall time per run in us
+costs=$(awk 'NR > 1 && $2 > 0 {
+	printf "%s %.1f %.1f %.0f\n", $1, $3 / $2, $4 / $2, $6 / $2
+}' "$stats")
+rm -f "$stats"
+
+if [ $update -eq 1 ]; then
+	{
+		echo "# operation xfers/op bytes/op, from bq25898s_bench.sh -u"
+		echo "$costs" | awk '{ print $1, $2, $3 }'
+	} > "$baseline"
+	echo "baseline written to $baseline"
+	exit 0
+fi
+
+echo
+echo "$costs" | awk -v thr="$threshold" -v base="$baseline" '
+BEGIN {
+	while ((getline line < base) > 0) {
+		if (line ~ /^#/)
+			continue
+		split(line, f, " ")
+		bx[f[1]] = f[2]
+		bb[f[1]] = f[3]
+	}
+	printf "%-11s %14s %14s %10s\n", "operation", "xfers/op", "bytes/op", "wall_us/op"
+}
+function check(op, what, now, was) {
+	if (was > 0 && now > was * (1 + thr / 100)) {
+		printf "REGRESSION: %s %s %.1f, baseline %.1f\n", op, what, now, was
+		fail = 1
+	}
+}
+{
+	printf "%-11s %6.1f (%5.1f) %6.1f (%5.1f) %10d\n", $1, $2, bx[$1], $3, bb[$1], $4
+	if (!($1 in bx)) {
+		printf "no baseline for %s\n", $1
+		next
+	}
+	check($1, "xfers", $2, bx[$1])
+	check($1, "bytes", $3, bb[$1])
+}
+END { exit fail }'
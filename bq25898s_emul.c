@@ -0,0 +1,1187 @@
+/*
+ * BQ25898S chip model for exercising the slave charger driver
+ *
+ * Registers an I2C adapter with a BQ25898S at 0x6B on it, so the driver
+ * probes against something that behaves like the chip: CONV_START and
+ * WD_RST clear themselves, the ADC results follow the modelled battery
+ * and input, CHRG_STAT moves through precharge/fast charge/done, an
+ * expired I2C watchdog resets the control registers, and status changes
+ * and faults pulse an INT line the driver requests like a GPIO interrupt.
+ *
+ * The battery and input are set, and events triggered, from debugfs under
+ * bq25898s-emul.<adapter nr>, see bq25898s_emul_debugfs_init(). The
+ * Kbuild file builds it next to the driver, "make -C <kernel> M=$PWD".
+ *
+ * Given a capacity, a cell model replaces the fixed battery voltage: OCV
+ * from the state of charge plus the drop across the internal resistance,
+ * and a thermal mass heated by that resistance and the charger's loss,
+ * read back through TS. The adapter has a current limit and its cable a
+ * resistance, so VBUS droops under load into VINDPM. Model time runs
+ * speedup times faster than the clock; the sim file reports time to 80%
+ * and to full, the peak temperature and the DPM events of the run, and a
+ * "battery" power supply reports the state of charge to the driver.
+ *
+ * With the bq25898s.dtsi settings passed as platform data, a 3000mAh cell
+ * charged from 10% (cap 3000, soc 10, full 95, speedup 100, vbus 5000,
+ * then 1 to the driver's adapter file) reaches 80% after about 60 model
+ * minutes and the RSOC cutoff after 83, peaking at 42C. Without the
+ * step-charge table, at a fixed 2250mA, that is 57 and 78 minutes at 43C:
+ * the example table only ever lowers ICHG, so it trades charge time for
+ * heat and cannot shorten time to full.
+ *
+ * Copyright (C) 2013 Texas Instruments
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irq_work.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/power_supply.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "bq25898s_reg.h"
+#include "bq25898s_slave.h"
+
+#define BQ25898S_EMUL_MAX		4
+#define BQ25898S_EMUL_ADDR		0x6b
+#define BQ25898S_EMUL_PN		1	/* BQ25898S */
+#define BQ25898S_EMUL_REV		1
+
+/* model step, also how late a watchdog expiry may be noticed */
+#define BQ25898S_EMUL_TICK_MS		100
+/* one-shot conversion, shorter than the driver's first CONV_START poll */
+#define BQ25898S_EMUL_CONV_MS		8
+#define BQ25898S_EMUL_ADC_MS		1000	/* continuous conversion period */
+
+#define BQ25898S_EMUL_VBUS_PG		3900	/* mV, power good above */
+#define BQ25898S_EMUL_VBUS_ADAPTER	5	/* VBUS_STAT, unknown adapter */
+#define BQ25898S_EMUL_EFFICIENCY	90	/* %, input to battery power */
+/* mA, what the die can take in thermal regulation whatever ICHG is */
+#define BQ25898S_EMUL_TREG_MA		1000
+
+/* cell model defaults and constants, see bq25898s_emul_advance() */
+#define BQ25898S_EMUL_RINT		80	/* mOhm */
+#define BQ25898S_EMUL_AMBIENT		25000	/* m degC */
+#define BQ25898S_EMUL_HEAT_CAP		45	/* J/K, a 3Ah phone cell */
+#define BQ25898S_EMUL_RTH		20	/* K/W, cell to ambient */
+#define BQ25898S_EMUL_LOSS_SHARE	50	/* %, of the charger loss heating the cell */
+
+/* REG_03 minimum system voltage, unused by the driver */
+#define BQ25898S_SYS_MIN_MASK		0x0E
+#define BQ25898S_SYS_MIN_SHIFT		1
+#define BQ25898S_SYS_MIN_BASE		3000
+#define BQ25898S_SYS_MIN_LSB		100
+
+static unsigned int instances = 1;
+module_param(instances, uint, S_IRUGO);
+MODULE_PARM_DESC(instances, "number of emulated chips, each on its own adapter");
+
+static bool i2c_block = true;
+module_param(i2c_block, bool, S_IRUGO);
+MODULE_PARM_DESC(i2c_block, "adapter does I2C block transfers, else byte transfers only");
+
+struct bq25898s_emul {
+	struct i2c_adapter	adap;
+	struct i2c_bus_recovery_info	rinfo;
+	struct i2c_client	*client;
+	struct dentry		*debugfs;
+	struct delayed_work	tick;
+
+	/* INT, pulses while the line is masked are latched like an edge */
+	int			irq;
+	struct irq_work		int_work;
+	spinlock_t		int_lock;
+	bool			int_masked;
+	bool			int_pending;
+
+	struct mutex		lock;		/* everything below */
+	u8			regs[BQ25898S_REG_NUM];	/* REG_0C is the fault latch */
+	bool			host_mode;	/* written since reset, watchdog runs */
+	unsigned long		wdt_stamp;	/* jiffies of the last watchdog reset */
+	unsigned long		conv_end;	/* jiffies, one-shot conversion done */
+	unsigned long		adc_next;	/* jiffies, next continuous conversion */
+	bool			term_done;	/* terminated, until recharge */
+
+	/* what the chip sees, set from debugfs */
+	int			vbus;		/* mV, adapter open circuit, 0 if none */
+	int			adapter_ma;	/* adapter current limit, 0 for none */
+	int			cable;		/* mOhm, adapter to VBUS */
+	int			vbat;		/* mV, follows the cell if there is one */
+	int			ts_pct;		/* 0.001% of REGN, ditto */
+	bool			therm;		/* die in thermal regulation */
+
+	/* cell model, off while cap is 0 */
+	int			cap;		/* mAh */
+	u64			charge;		/* uAs */
+	int			soc;		/* 0.1% */
+	int			rint;		/* mOhm */
+	int			full;		/* %, counts as full for the run */
+	int			ambient;	/* m degC */
+	s64			temp;		/* u degC */
+	int			speedup;	/* model time per clock time */
+	unsigned long		sim_stamp;	/* jiffies, model last advanced */
+	struct power_supply	psy;		/* "battery", first instance only */
+	bool			psy_registered;
+
+	/* the run since cap or soc was last written, times in model ms */
+	u64			run_ms;
+	s64			chg_start;	/* first charge current, -1 before */
+	s64			time_to_80;
+	s64			time_to_full;	/* termination or full */
+	int			peak_temp;	/* m degC */
+	u32			vdpm_events;
+	u32			idpm_events;
+
+	/* what the chip does about it, see bq25898s_emul_charge() */
+	int			vbus_now;	/* mV, at the pin */
+	int			ichg;		/* mA */
+	bool			vdpm;
+	bool			idpm;
+
+	u32			naks;		/* transfers still to NAK */
+	u32			int_pulses;
+	u32			wdt_expired;
+	u32			conversions;
+	u32			recoveries;
+};
+
+static struct bq25898s_emul *bq25898s_emul_dev[BQ25898S_EMUL_MAX];
+
+/*
+ * What bq25898s.dtsi gives the driver, passed as platform data since the
+ * client has no DT node; termination is on so ITERM ends a charge.
+ */
+static const u32 bq25898s_emul_step[] = {
+	3500, 2250,
+	4100, 1500,
+	4250, 1000,
+};
+
+static const u32 bq25898s_emul_thermal[] = {
+	-1, -1,
+	1500, 1500,
+	1000, 1000,
+	0, 500,
+};
+
+static const u32 bq25898s_emul_jeita[] = {
+	68000, 73000, 4100, 500,
+	47000, 68000, 4200, 2250,
+	40000, 47000, 4100, 1000,
+};
+
+static struct bq2589x_platform_data bq25898s_emul_pdata = {
+	.charge_voltage		= 4200,
+	.charge_current		= 2250,
+	.term_current		= 512,
+	.input_current_limit	= 2000,
+	.input_voltage_limit	= 4600,
+	.enable_term		= true,
+	.aicl_max_current	= 3000,
+	.current_share		= 50,
+	.step_charge		= bq25898s_emul_step,
+	.step_num		= ARRAY_SIZE(bq25898s_emul_step) / 2,
+	.thermal_mitigation	= bq25898s_emul_thermal,
+	.thermal_num		= ARRAY_SIZE(bq25898s_emul_thermal) / 2,
+	.jeita_zones		= bq25898s_emul_jeita,
+	.jeita_num		= ARRAY_SIZE(bq25898s_emul_jeita) / 4,
+};
+
+/* power-on values, REG_0C and the status and ADC registers start out 0 */
+static const u8 bq25898s_emul_defaults[BQ25898S_REG_NUM] = {
+	[BQ25898S_REG_00] = 0x48,	/* EN_ILIM, IINLIM 500mA */
+	[BQ25898S_REG_01] = 0x05,
+	[BQ25898S_REG_02] = 0x1d,	/* AUTO_DPDM_EN */
+	[BQ25898S_REG_03] = 0x3a,	/* CHG_CONFIG, SYS_MIN 3.5V */
+	[BQ25898S_REG_04] = 0x20,	/* ICHG 2048mA */
+	[BQ25898S_REG_05] = 0x13,	/* IPRECHG 128mA, ITERM 256mA */
+	[BQ25898S_REG_06] = 0x5e,	/* VREG 4208mV, BATLOWV 3.0V */
+	[BQ25898S_REG_07] = 0x9d,	/* EN_TERM, WDT 40s, EN_TIMER 12h */
+	[BQ25898S_REG_08] = 0x03,	/* TREG 120C */
+	[BQ25898S_REG_09] = 0x44,
+	[BQ25898S_REG_0A] = 0x93,
+	[BQ25898S_REG_0D] = 0x12,	/* VINDPM 4400mV */
+	[BQ25898S_REG_14] = (BQ25898S_EMUL_PN << BQ25898S_PN_SHIFT) | BQ25898S_EMUL_REV,
+};
+
+/* bits the host can change, the rest is status or ADC result */
+static const u8 bq25898s_emul_writable[BQ25898S_REG_NUM] = {
+	[BQ25898S_REG_00 ... BQ25898S_REG_0A] = 0xff,
+	[BQ25898S_REG_0D] = 0xff,
+	[BQ25898S_REG_14] = BQ25898S_RESET_MASK,
+};
+
+#define bq25898s_emul_field(regs, reg, f) \
+	(((regs)[BQ25898S_REG_##reg] & BQ25898S_##f##_MASK) >> BQ25898S_##f##_SHIFT)
+
+#define bq25898s_emul_value(regs, reg, f) \
+	(BQ25898S_##f##_BASE + bq25898s_emul_field(regs, reg, f) * BQ25898S_##f##_LSB)
+
+/* ADC code for @val, saturating at both ends of the field */
+#define bq25898s_emul_code(val, f) \
+	((u8)clamp_t(int, ((val) - BQ25898S_##f##_BASE) / BQ25898S_##f##_LSB, 0, \
+		BQ25898S_##f##_MASK >> BQ25898S_##f##_SHIFT) << BQ25898S_##f##_SHIFT)
+
+struct bq25898s_emul_point {
+	int	x;
+	int	y;
+};
+
+/* open circuit voltage (mV) over state of charge (0.1%), a LiCoO2 cell */
+static const struct bq25898s_emul_point bq25898s_emul_ocv[] = {
+	{ 0, 3400 }, { 50, 3600 }, { 100, 3680 }, { 200, 3730 },
+	{ 300, 3770 }, { 400, 3800 }, { 500, 3840 }, { 600, 3890 },
+	{ 700, 3950 }, { 800, 4020 }, { 900, 4100 }, { 1000, 4180 },
+};
+
+/* TS (0.001% of REGN) over temperature (m degC), 10k NTC in the usual divider */
+static const struct bq25898s_emul_point bq25898s_emul_ntc[] = {
+	{ -10000, 79000 }, { 0, 73500 }, { 10000, 68000 }, { 20000, 61000 },
+	{ 30000, 53600 }, { 40000, 47400 }, { 45000, 44700 }, { 50000, 41600 },
+	{ 60000, 34400 }, { 70000, 29000 },
+};
+
+/* linear between the points of @tbl, ascending x, flat beyond its ends */
+static int bq25898s_emul_interp(const struct bq25898s_emul_point *tbl, int num, int x)
+{
+	int i;
+
+	if (x <= tbl[0].x)
+		return tbl[0].y;
+
+	for (i = 1; i < num; i++) {
+		if (x <= tbl[i].x)
+			return tbl[i - 1].y + (x - tbl[i - 1].x) *
+				(tbl[i].y - tbl[i - 1].y) / (tbl[i].x - tbl[i - 1].x);
+	}
+
+	return tbl[num - 1].y;
+}
+
+static void bq25898s_emul_pulse(struct bq25898s_emul *emul)
+{
+	unsigned long flags;
+
+	emul->int_pulses++;
+
+	spin_lock_irqsave(&emul->int_lock, flags);
+	if (emul->int_masked)
+		emul->int_pending = true;
+	else
+		irq_work_queue(&emul->int_work);
+	spin_unlock_irqrestore(&emul->int_lock, flags);
+}
+
+/* the line is a chip output, handle it from hard interrupt context */
+static void bq25898s_emul_int_work(struct irq_work *work)
+{
+	struct bq25898s_emul *emul = container_of(work, struct bq25898s_emul, int_work);
+
+	generic_handle_irq(emul->irq);
+}
+
+static void bq25898s_emul_int_mask(struct irq_data *d)
+{
+	struct bq25898s_emul *emul = irq_data_get_irq_chip_data(d);
+
+	spin_lock(&emul->int_lock);
+	emul->int_masked = true;
+	spin_unlock(&emul->int_lock);
+}
+
+/* replay a pulse that came in while masked, e.g. during a oneshot thread */
+static void bq25898s_emul_int_unmask(struct irq_data *d)
+{
+	struct bq25898s_emul *emul = irq_data_get_irq_chip_data(d);
+
+	spin_lock(&emul->int_lock);
+	emul->int_masked = false;
+	if (emul->int_pending) {
+		emul->int_pending = false;
+		irq_work_queue(&emul->int_work);
+	}
+	spin_unlock(&emul->int_lock);
+}
+
+static struct irq_chip bq25898s_emul_int_chip = {
+	.name		= "bq25898s-emul",
+	.irq_mask	= bq25898s_emul_int_mask,
+	.irq_unmask	= bq25898s_emul_int_unmask,
+};
+
+/* control registers back to defaults, as on REG_RST or a watchdog expiry */
+static void bq25898s_emul_reset(struct bq25898s_emul *emul)
+{
+	u8 reg;
+
+	for (reg = 0; reg < BQ25898S_REG_NUM; reg++) {
+		if (bq25898s_emul_writable[reg])
+			emul->regs[reg] = bq25898s_emul_defaults[reg];
+	}
+	emul->host_mode = false;
+	emul->term_done = false;
+}
+
+/*
+ * Charge and input regulation for the present battery and input. Without
+ * the cell model the battery is held at what debugfs says, so at VREG
+ * there is nothing left to taper and the charge terminates right away if
+ * EN_TERM is set.
+ */
+static void bq25898s_emul_charge(struct bq25898s_emul *emul)
+{
+	u8 *regs = emul->regs;
+	int vreg = bq25898s_emul_value(regs, 06, VREG);
+	int iinlim = bq25898s_emul_value(regs, 00, IINLIM);
+	int iterm = bq25898s_emul_value(regs, 05, ITERM);
+	int vindpm = bq25898s_emul_value(regs, 0D, VINDPM);
+	int batlowv = bq25898s_emul_field(regs, 06, BATLOWV) ? 3000 : 2800;
+	int vrechg = bq25898s_emul_field(regs, 06, VRECHG) ? 200 : 100;
+	int rint = emul->cap ? emul->rint : 0;
+	int ocv = emul->vbat;
+	int vbus = emul->vbus;
+	u8 stat = BQ25898S_CHRG_STAT_IDLE;
+	u8 vbus_stat = 0;
+	bool vdpm = false;
+	bool idpm = false;
+	int ichg = 0;
+	int icv;
+	int ilim;
+	int ivdpm;
+	int iin;
+	int pin;
+
+	if (emul->cap)
+		ocv = bq25898s_emul_interp(bq25898s_emul_ocv,
+				ARRAY_SIZE(bq25898s_emul_ocv), emul->soc);
+
+	if (emul->term_done && ocv < vreg - vrechg)
+		emul->term_done = false;
+
+	if (emul->vbus >= BQ25898S_EMUL_VBUS_PG && !bq25898s_emul_field(regs, 00, ENHIZ)) {
+		vbus_stat = BQ25898S_EMUL_VBUS_ADAPTER;
+
+		/* what the CV loop leaves for the charge current */
+		if (ocv >= vreg)
+			icv = 0;
+		else
+			icv = rint ? (vreg - ocv) * 1000 / rint : INT_MAX;
+
+		if (!bq25898s_emul_field(regs, 03, CHG_CONFIG)) {
+			stat = BQ25898S_CHRG_STAT_IDLE;
+		} else if (ocv < batlowv) {
+			stat = BQ25898S_CHRG_STAT_PRECHG;
+			ichg = bq25898s_emul_value(regs, 05, IPRECHG);
+		} else if (emul->term_done) {
+			stat = BQ25898S_CHRG_STAT_CHGDONE;
+		} else if (icv < iterm && bq25898s_emul_field(regs, 07, EN_TERM)) {
+			stat = BQ25898S_CHRG_STAT_CHGDONE;
+			emul->term_done = true;
+		} else {
+			stat = BQ25898S_CHRG_STAT_FASTCHG;
+			ichg = min(bq25898s_emul_value(regs, 04, ICHG), icv);
+		}
+
+		/*
+		 * Input current for @ichg, one step for the cable droop. An
+		 * adapter in current limit collapses onto VINDPM like the cable
+		 * does, IINLIM is the chip's own.
+		 */
+		ilim = iinlim;
+		if (emul->adapter_ma && emul->adapter_ma < ilim)
+			ilim = emul->adapter_ma;
+		if (emul->vbus <= vindpm)
+			ivdpm = 0;
+		else if (emul->cable)
+			ivdpm = (emul->vbus - vindpm) * 1000 / emul->cable;
+		else
+			ivdpm = INT_MAX;
+
+		pin = (ocv + ichg * rint / 1000) * ichg / BQ25898S_EMUL_EFFICIENCY * 100;
+		iin = pin / emul->vbus;
+		iin = pin / max(emul->vbus - iin * emul->cable / 1000, vindpm);
+
+		if (iin > min(ilim, ivdpm) || !ivdpm) {
+			iin = min(ilim, ivdpm);
+			if (ivdpm <= ilim || ilim < iinlim) {
+				vdpm = true;
+				vbus = min(emul->vbus, vindpm);
+			} else {
+				idpm = true;
+				vbus = emul->vbus - iin * emul->cable / 1000;
+			}
+			ichg = min(ichg, iin * vbus / max(ocv + ichg * rint / 1000, 1) *
+					BQ25898S_EMUL_EFFICIENCY / 100);
+		} else {
+			vbus = emul->vbus - iin * emul->cable / 1000;
+		}
+
+		/* die temperature regulation */
+		if (emul->therm)
+			ichg = min(ichg, BQ25898S_EMUL_TREG_MA);
+	} else {
+		emul->term_done = false;
+	}
+
+	if (vdpm && !emul->vdpm)
+		emul->vdpm_events++;
+	if (idpm && !emul->idpm)
+		emul->idpm_events++;
+	emul->vdpm = vdpm;
+	emul->idpm = idpm;
+	emul->vbus_now = vbus;
+	emul->ichg = ichg;
+	if (emul->cap)
+		emul->vbat = ocv + ichg * rint / 1000;
+
+	regs[BQ25898S_REG_0B] = (vbus_stat << BQ25898S_VBUS_STAT_SHIFT) |
+			(stat << BQ25898S_CHRG_STAT_SHIFT) |
+			(vbus_stat ? BQ25898S_PG_STAT_MASK : 0);
+
+	/* status bits next to the ADC results follow the chip at once */
+	regs[BQ25898S_REG_0E] &= ~BQ25898S_THERM_STAT_MASK;
+	if (emul->therm)
+		regs[BQ25898S_REG_0E] |= BQ25898S_THERM_STAT_MASK;
+	regs[BQ25898S_REG_11] &= ~BQ25898S_VBUS_GD_MASK;
+	if (vbus_stat)
+		regs[BQ25898S_REG_11] |= BQ25898S_VBUS_GD_MASK;
+	regs[BQ25898S_REG_13] = (emul->vdpm ? BQ25898S_VDPM_STAT_MASK : 0) |
+			(emul->idpm ? BQ25898S_IDPM_STAT_MASK : 0) |
+			bq25898s_emul_code(iinlim, IDPM_LIM);
+}
+
+/* model ms per step, well below the cell's thermal time constant */
+#define BQ25898S_EMUL_STEP_MS		10000
+
+/*
+ * Move the cell on by the model time since the last call, at the charge
+ * current of the last bq25898s_emul_charge(): charge, and temperature from
+ * I^2*R and part of the charger loss against the cooling to ambient.
+ */
+static void bq25898s_emul_advance(struct bq25898s_emul *emul)
+{
+	unsigned long now = jiffies;
+	s64 dt = (s64)jiffies_to_msecs(now - emul->sim_stamp) * emul->speedup;
+	int ichg = emul->ichg;
+	int old_soc = emul->soc;
+	s64 step;
+	s64 heat;
+
+	emul->sim_stamp = now;
+	if (!emul->cap)
+		return;
+
+	if (emul->chg_start >= 0 && emul->time_to_full < 0 &&
+	    (emul->term_done || emul->soc >= emul->full * 10))
+		emul->time_to_full = emul->run_ms - emul->chg_start;
+	if (ichg && emul->chg_start < 0)
+		emul->chg_start = emul->run_ms;
+
+	for (; dt > 0; dt -= step) {
+		step = min_t(s64, dt, BQ25898S_EMUL_STEP_MS);
+
+		emul->charge = min_t(u64, emul->charge + (u64)ichg * step,
+				(u64)emul->cap * 3600000);
+
+		/* mW, mA^2 * mOhm and mV * mA scaled down */
+		heat = (s64)ichg * ichg * emul->rint / 1000000 +
+			(s64)emul->vbat * ichg / 1000 * (100 - BQ25898S_EMUL_EFFICIENCY) /
+			BQ25898S_EMUL_EFFICIENCY * BQ25898S_EMUL_LOSS_SHARE / 100;
+		heat -= (div_s64(emul->temp, 1000) - emul->ambient) / BQ25898S_EMUL_RTH;
+		/* mW * ms / (J/K) is u degC */
+		emul->temp += div_s64(heat * step, BQ25898S_EMUL_HEAT_CAP);
+
+		emul->run_ms += step;
+		emul->peak_temp = max_t(int, emul->peak_temp, div_s64(emul->temp, 1000));
+	}
+
+	emul->soc = div_u64(emul->charge, emul->cap * 3600);
+	emul->ts_pct = bq25898s_emul_interp(bq25898s_emul_ntc,
+			ARRAY_SIZE(bq25898s_emul_ntc), div_s64(emul->temp, 1000));
+	if (emul->chg_start >= 0 && emul->time_to_80 < 0 && emul->soc >= 800)
+		emul->time_to_80 = emul->run_ms - emul->chg_start;
+
+	/* a gauge reports whole percents */
+	if (emul->psy_registered && emul->soc / 10 != old_soc / 10)
+		power_supply_changed(&emul->psy);
+}
+
+/* start a run from @soc (0.1%) at ambient temperature */
+static void bq25898s_emul_new_run(struct bq25898s_emul *emul, int soc)
+{
+	emul->soc = clamp(soc, 0, 1000);
+	emul->charge = (u64)emul->cap * 3600 * emul->soc;
+	emul->temp = (s64)emul->ambient * 1000;
+	emul->peak_temp = emul->ambient;
+	emul->run_ms = 0;
+	emul->chg_start = -1;
+	emul->time_to_80 = -1;
+	emul->time_to_full = -1;
+	emul->vdpm_events = 0;
+	emul->idpm_events = 0;
+	emul->sim_stamp = jiffies;
+}
+
+static void bq25898s_emul_convert(struct bq25898s_emul *emul)
+{
+	u8 *regs = emul->regs;
+	int sys_min = bq25898s_emul_value(regs, 03, SYS_MIN);
+
+	regs[BQ25898S_REG_0E] &= BQ25898S_THERM_STAT_MASK;
+	regs[BQ25898S_REG_0E] |= bq25898s_emul_code(emul->vbat, BATV);
+	regs[BQ25898S_REG_0F] = bq25898s_emul_code(max(emul->vbat, sys_min), SYSV);
+	regs[BQ25898S_REG_10] = bq25898s_emul_code(emul->ts_pct, TSPCT);
+	regs[BQ25898S_REG_11] &= BQ25898S_VBUS_GD_MASK;
+	regs[BQ25898S_REG_11] |= bq25898s_emul_code(emul->vbus_now, VBUSV);
+	regs[BQ25898S_REG_12] = bq25898s_emul_code(emul->ichg, ICHGR);
+	emul->conversions++;
+}
+
+/*
+ * Bring the model up to now, called with the lock held before and after
+ * every transfer and from the tick. Pulses INT on a charge or input status
+ * change and on a new fault, like the chip does.
+ */
+static void bq25898s_emul_update(struct bq25898s_emul *emul)
+{
+	u8 *regs = emul->regs;
+	u8 status = regs[BQ25898S_REG_0B];
+	u8 fault = regs[BQ25898S_REG_0C];
+	int wdt = bq25898s_emul_field(regs, 07, WDT);
+
+	if (emul->host_mode && wdt &&
+	    time_after_eq(jiffies, emul->wdt_stamp + msecs_to_jiffies(40000 << (wdt - 1)))) {
+		bq25898s_emul_reset(emul);
+		regs[BQ25898S_REG_0C] |= BQ25898S_FAULT_WDT_MASK;
+		emul->wdt_expired++;
+	}
+
+	bq25898s_emul_advance(emul);
+	bq25898s_emul_charge(emul);
+
+	if ((regs[BQ25898S_REG_02] & BQ25898S_CONV_START_MASK) &&
+	    time_after_eq(jiffies, emul->conv_end)) {
+		bq25898s_emul_convert(emul);
+		regs[BQ25898S_REG_02] &= ~BQ25898S_CONV_START_MASK;
+	}
+	if ((regs[BQ25898S_REG_02] & BQ25898S_CONV_RATE_MASK) &&
+	    time_after_eq(jiffies, emul->adc_next)) {
+		bq25898s_emul_convert(emul);
+		emul->adc_next = jiffies + msecs_to_jiffies(BQ25898S_EMUL_ADC_MS);
+	}
+
+	if (((status ^ regs[BQ25898S_REG_0B]) &
+	     (BQ25898S_VBUS_STAT_MASK | BQ25898S_CHRG_STAT_MASK | BQ25898S_PG_STAT_MASK)) ||
+	    (regs[BQ25898S_REG_0C] & ~fault))
+		bq25898s_emul_pulse(emul);
+}
+
+/* reading the fault register hands out the latched faults and clears them */
+static u8 bq25898s_emul_read(struct bq25898s_emul *emul, u8 reg)
+{
+	u8 val;
+
+	if (reg >= BQ25898S_REG_NUM)
+		return 0;
+
+	val = emul->regs[reg];
+	if (reg == BQ25898S_REG_0C)
+		emul->regs[reg] = 0;
+
+	return val;
+}
+
+static void bq25898s_emul_write(struct bq25898s_emul *emul, u8 reg, u8 val)
+{
+	u8 *regs = emul->regs;
+	u8 mask;
+	u8 old;
+
+	if (reg >= BQ25898S_REG_NUM)
+		return;
+
+	/* the first write after reset leaves default mode and starts the watchdog */
+	if (!emul->host_mode) {
+		emul->host_mode = true;
+		emul->wdt_stamp = jiffies;
+	}
+
+	mask = bq25898s_emul_writable[reg];
+	old = regs[reg];
+	regs[reg] = (old & ~mask) | (val & mask);
+
+	switch (reg) {
+	case BQ25898S_REG_02:
+		/* a running conversion can't be stopped */
+		if (old & BQ25898S_CONV_START_MASK)
+			regs[reg] |= BQ25898S_CONV_START_MASK;
+		else if (val & BQ25898S_CONV_START_MASK)
+			emul->conv_end = jiffies + msecs_to_jiffies(BQ25898S_EMUL_CONV_MS);
+		if ((val & ~old) & BQ25898S_CONV_RATE_MASK)
+			emul->adc_next = jiffies + msecs_to_jiffies(BQ25898S_EMUL_CONV_MS);
+		/* no D+/D- to detect anything on */
+		regs[reg] &= ~BQ25898S_FORCE_DPDM_MASK;
+		break;
+	case BQ25898S_REG_03:
+		if (val & BQ25898S_WDT_RESET_MASK)
+			emul->wdt_stamp = jiffies;
+		regs[reg] &= ~BQ25898S_WDT_RESET_MASK;
+		/* a new charge cycle */
+		if ((val & ~old) & BQ25898S_CHG_CONFIG_MASK)
+			emul->term_done = false;
+		break;
+	case BQ25898S_REG_07:
+		if ((old ^ val) & BQ25898S_WDT_MASK)
+			emul->wdt_stamp = jiffies;
+		break;
+	case BQ25898S_REG_09:
+		regs[reg] &= ~(BQ25898S_FORCE_ICO_MASK | BQ25898S_PUMPX_MASK);
+		break;
+	case BQ25898S_REG_14:
+		if (val & BQ25898S_RESET_MASK)
+			bq25898s_emul_reset(emul);
+		break;
+	}
+}
+
+static int bq25898s_emul_xfer(struct i2c_adapter *adap, u16 addr,
+				unsigned short flags, char read_write, u8 command,
+				int size, union i2c_smbus_data *data)
+{
+	struct bq25898s_emul *emul = i2c_get_adapdata(adap);
+	int ret = 0;
+	u8 len;
+	u8 i;
+
+	if (addr != BQ25898S_EMUL_ADDR)
+		return -ENXIO;
+
+	mutex_lock(&emul->lock);
+	if (emul->naks) {
+		emul->naks--;
+		ret = -ENXIO;
+		goto out;
+	}
+
+	bq25898s_emul_update(emul);
+
+	switch (size) {
+	case I2C_SMBUS_QUICK:
+		break;
+	case I2C_SMBUS_BYTE_DATA:
+		if (read_write == I2C_SMBUS_READ)
+			data->byte = bq25898s_emul_read(emul, command);
+		else
+			bq25898s_emul_write(emul, command, data->byte);
+		break;
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		if (!i2c_block) {
+			ret = -EOPNOTSUPP;
+			break;
+		}
+		len = min_t(u8, data->block[0], I2C_SMBUS_BLOCK_MAX);
+		for (i = 0; i < len; i++) {
+			if (read_write == I2C_SMBUS_READ)
+				data->block[i + 1] = bq25898s_emul_read(emul, command + i);
+			else
+				bq25898s_emul_write(emul, command + i, data->block[i + 1]);
+		}
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+
+	bq25898s_emul_update(emul);
+out:
+	mutex_unlock(&emul->lock);
+
+	return ret;
+}
+
+static u32 bq25898s_emul_functionality(struct i2c_adapter *adap)
+{
+	u32 func = I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE_DATA;
+
+	if (i2c_block)
+		func |= I2C_FUNC_SMBUS_I2C_BLOCK;
+
+	return func;
+}
+
+static const struct i2c_algorithm bq25898s_emul_algo = {
+	.smbus_xfer	= bq25898s_emul_xfer,
+	.functionality	= bq25898s_emul_functionality,
+};
+
+/* clocking out the bus releases a slave that was stuck NAKing */
+static int bq25898s_emul_recover_bus(struct i2c_adapter *adap)
+{
+	struct bq25898s_emul *emul = i2c_get_adapdata(adap);
+
+	mutex_lock(&emul->lock);
+	emul->naks = 0;
+	emul->recoveries++;
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+
+/* time based behaviour: watchdog, conversions and unprompted status changes */
+static void bq25898s_emul_tick(struct work_struct *work)
+{
+	struct bq25898s_emul *emul = container_of(work, struct bq25898s_emul, tick.work);
+
+	mutex_lock(&emul->lock);
+	bq25898s_emul_update(emul);
+	mutex_unlock(&emul->lock);
+
+	schedule_delayed_work(&emul->tick, msecs_to_jiffies(BQ25898S_EMUL_TICK_MS));
+}
+
+static enum power_supply_property bq25898s_emul_battery_props[] = {
+	POWER_SUPPLY_PROP_PRESENT,
+	POWER_SUPPLY_PROP_CAPACITY,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_TEMP,
+};
+
+/* the gauge next to the cell model, for the driver's capacity cutoff */
+static int bq25898s_emul_battery_get_property(struct power_supply *psy,
+				enum power_supply_property psp,
+				union power_supply_propval *val)
+{
+	struct bq25898s_emul *emul = container_of(psy, struct bq25898s_emul, psy);
+	int ret = 0;
+
+	mutex_lock(&emul->lock);
+	if (!emul->cap && psp != POWER_SUPPLY_PROP_PRESENT) {
+		mutex_unlock(&emul->lock);
+		return -ENODATA;
+	}
+
+	switch (psp) {
+	case POWER_SUPPLY_PROP_PRESENT:
+		val->intval = !!emul->cap;
+		break;
+	case POWER_SUPPLY_PROP_CAPACITY:
+		val->intval = emul->soc / 10;
+		break;
+	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		val->intval = emul->vbat * 1000;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_NOW:
+		val->intval = emul->ichg * 1000;
+		break;
+	case POWER_SUPPLY_PROP_TEMP:
+		val->intval = div_s64(emul->temp, 100000);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	mutex_unlock(&emul->lock);
+
+	return ret;
+}
+
+#define BQ25898S_EMUL_ATTR(_name, _field)					\
+static int bq25898s_emul_##_name##_get(void *data, u64 *val)		\
+{									\
+	struct bq25898s_emul *emul = data;				\
+									\
+	mutex_lock(&emul->lock);					\
+	*val = emul->_field;						\
+	mutex_unlock(&emul->lock);					\
+									\
+	return 0;							\
+}									\
+									\
+static int bq25898s_emul_##_name##_set(void *data, u64 val)		\
+{									\
+	struct bq25898s_emul *emul = data;				\
+									\
+	mutex_lock(&emul->lock);					\
+	emul->_field = val;						\
+	bq25898s_emul_update(emul);					\
+	mutex_unlock(&emul->lock);					\
+									\
+	return 0;							\
+}									\
+DEFINE_SIMPLE_ATTRIBUTE(bq25898s_emul_##_name##_fops,			\
+		bq25898s_emul_##_name##_get, bq25898s_emul_##_name##_set, "%llu\n")
+
+BQ25898S_EMUL_ATTR(vbus, vbus);
+BQ25898S_EMUL_ATTR(vbat, vbat);
+BQ25898S_EMUL_ATTR(ts, ts_pct);
+BQ25898S_EMUL_ATTR(therm, therm);
+BQ25898S_EMUL_ATTR(nak, naks);
+BQ25898S_EMUL_ATTR(adapter_ma, adapter_ma);
+BQ25898S_EMUL_ATTR(cable, cable);
+BQ25898S_EMUL_ATTR(rint, rint);
+BQ25898S_EMUL_ATTR(ambient, ambient);
+BQ25898S_EMUL_ATTR(speedup, speedup);
+BQ25898S_EMUL_ATTR(full, full);
+
+static int bq25898s_emul_cap_get(void *data, u64 *val)
+{
+	struct bq25898s_emul *emul = data;
+
+	mutex_lock(&emul->lock);
+	*val = emul->cap;
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+
+/* a new capacity starts a new run at the present state of charge */
+static int bq25898s_emul_cap_set(void *data, u64 val)
+{
+	struct bq25898s_emul *emul = data;
+
+	mutex_lock(&emul->lock);
+	emul->cap = val;
+	bq25898s_emul_new_run(emul, emul->soc);
+	bq25898s_emul_update(emul);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(bq25898s_emul_cap_fops, bq25898s_emul_cap_get,
+		bq25898s_emul_cap_set, "%llu\n");
+
+static int bq25898s_emul_soc_get(void *data, u64 *val)
+{
+	struct bq25898s_emul *emul = data;
+
+	mutex_lock(&emul->lock);
+	*val = emul->soc / 10;
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+
+static int bq25898s_emul_soc_set(void *data, u64 val)
+{
+	struct bq25898s_emul *emul = data;
+
+	if (val > 100)
+		return -EINVAL;
+
+	mutex_lock(&emul->lock);
+	bq25898s_emul_new_run(emul, val * 10);
+	bq25898s_emul_update(emul);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(bq25898s_emul_soc_fops, bq25898s_emul_soc_get,
+		bq25898s_emul_soc_set, "%llu\n");
+
+/* latch faults into REG_0C, which pulses INT like a real one would */
+static int bq25898s_emul_fault_set(void *data, u64 val)
+{
+	struct bq25898s_emul *emul = data;
+
+	mutex_lock(&emul->lock);
+	emul->regs[BQ25898S_REG_0C] |= val;
+	bq25898s_emul_update(emul);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(bq25898s_emul_fault_fops, NULL, bq25898s_emul_fault_set, "0x%02llx\n");
+
+/* an interrupt without a status change, e.g. a glitch on the line */
+static int bq25898s_emul_int_set(void *data, u64 val)
+{
+	struct bq25898s_emul *emul = data;
+
+	mutex_lock(&emul->lock);
+	bq25898s_emul_pulse(emul);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(bq25898s_emul_int_fops, NULL, bq25898s_emul_int_set, "%llu\n");
+
+/* what the chip holds, without the side effects of reading it over the bus */
+static int bq25898s_emul_state_show(struct seq_file *m, void *unused)
+{
+	struct bq25898s_emul *emul = m->private;
+	u8 reg;
+
+	mutex_lock(&emul->lock);
+	for (reg = 0; reg < BQ25898S_REG_NUM; reg++)
+		seq_printf(m, "Reg[0x%.2x] = 0x%.2x\n", reg, emul->regs[reg]);
+	seq_printf(m, "ichg_ma: %d\nvdpm: %d\nidpm: %d\n", emul->ichg, emul->vdpm, emul->idpm);
+	seq_printf(m, "int_pulses: %u\nwdt_expired: %u\nconversions: %u\nbus_recoveries: %u\n",
+			emul->int_pulses, emul->wdt_expired, emul->conversions, emul->recoveries);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+
+static int bq25898s_emul_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq25898s_emul_state_show, inode->i_private);
+}
+
+static const struct file_operations bq25898s_emul_state_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq25898s_emul_state_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/* the run so far, in model time; -1 for what hasn't happened yet */
+static int bq25898s_emul_sim_show(struct seq_file *m, void *unused)
+{
+	struct bq25898s_emul *emul = m->private;
+
+	mutex_lock(&emul->lock);
+	bq25898s_emul_update(emul);
+	if (!emul->cap) {
+		mutex_unlock(&emul->lock);
+		seq_puts(m, "no cell model, set cap\n");
+		return 0;
+	}
+
+	seq_printf(m, "run_ms: %llu\n", emul->run_ms);
+	seq_printf(m, "soc: %d.%d%%\n", emul->soc / 10, emul->soc % 10);
+	seq_printf(m, "charge_mah: %llu\n", div_u64(emul->charge, 3600000));
+	seq_printf(m, "vbat_mv: %d\nichg_ma: %d\nvbus_mv: %d\n",
+			emul->vbat, emul->ichg, emul->vbus_now);
+	seq_printf(m, "temp_mc: %lld\npeak_temp_mc: %d\n",
+			div_s64(emul->temp, 1000), emul->peak_temp);
+	seq_printf(m, "time_to_80_ms: %lld\ntime_to_full_ms: %lld\n",
+			emul->time_to_80, emul->time_to_full);
+	seq_printf(m, "vindpm_events: %u\niindpm_events: %u\n",
+			emul->vdpm_events, emul->idpm_events);
+	mutex_unlock(&emul->lock);
+
+	return 0;
+}
+
+static int bq25898s_emul_sim_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq25898s_emul_sim_show, inode->i_private);
+}
+
+static const struct file_operations bq25898s_emul_sim_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq25898s_emul_sim_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * vbus, vbat (mV), ts (0.001% of REGN) and therm (0/1) set what the chip
+ * sees; fault ORs bits into REG_0C, int pulses INT and nak makes the chip
+ * NAK that many transfers or until the bus is recovered.
+ *
+ * vbus is the adapter's open circuit voltage, adapter_ma its current limit
+ * and cable (mOhm) the resistance to VBUS. cap (mAh) turns on the cell
+ * model, which then drives vbat and ts; soc (%), rint (mOhm) and ambient
+ * (m degC) set it up, speedup is the model time per clock time. Writing
+ * cap or soc starts a new run for sim, which counts the cell as full at
+ * termination or at full (%), e.g. 95 for the driver's capacity cutoff.
+ */
+static void bq25898s_emul_debugfs_init(struct bq25898s_emul *emul)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "bq25898s-emul.%d", i2c_adapter_id(&emul->adap));
+	emul->debugfs = debugfs_create_dir(name, NULL);
+	if (IS_ERR_OR_NULL(emul->debugfs)) {
+		emul->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("vbus", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_vbus_fops);
+	debugfs_create_file("vbat", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_vbat_fops);
+	debugfs_create_file("ts", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_ts_fops);
+	debugfs_create_file("therm", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_therm_fops);
+	debugfs_create_file("nak", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_nak_fops);
+	debugfs_create_file("fault", S_IWUSR, emul->debugfs, emul, &bq25898s_emul_fault_fops);
+	debugfs_create_file("int", S_IWUSR, emul->debugfs, emul, &bq25898s_emul_int_fops);
+	debugfs_create_file("state", S_IRUGO, emul->debugfs, emul, &bq25898s_emul_state_fops);
+	debugfs_create_file("adapter_ma", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_adapter_ma_fops);
+	debugfs_create_file("cable", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_cable_fops);
+	debugfs_create_file("cap", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_cap_fops);
+	debugfs_create_file("soc", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_soc_fops);
+	debugfs_create_file("rint", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_rint_fops);
+	debugfs_create_file("ambient", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_ambient_fops);
+	debugfs_create_file("speedup", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_speedup_fops);
+	debugfs_create_file("full", S_IRUGO | S_IWUSR, emul->debugfs, emul, &bq25898s_emul_full_fops);
+	debugfs_create_file("sim", S_IRUGO, emul->debugfs, emul, &bq25898s_emul_sim_fops);
+}
+
+static int bq25898s_emul_setup_irq(struct bq25898s_emul *emul)
+{
+	int irq;
+
+	irq = irq_alloc_desc_from(1, numa_node_id());
+	if (irq < 0)
+		return irq;
+
+	irq_set_chip_data(irq, emul);
+	irq_set_chip_and_handler(irq, &bq25898s_emul_int_chip, handle_level_irq);
+	irq_modify_status(irq, IRQ_NOREQUEST | IRQ_NOAUTOEN, IRQ_NOPROBE);
+	emul->irq = irq;
+
+	return 0;
+}
+
+static void bq25898s_emul_destroy(struct bq25898s_emul *emul)
+{
+	/* the driver's remove still talks to the chip */
+	if (emul->client)
+		i2c_unregister_device(emul->client);
+	if (emul->psy_registered)
+		power_supply_unregister(&emul->psy);
+	cancel_delayed_work_sync(&emul->tick);
+	debugfs_remove_recursive(emul->debugfs);
+	i2c_del_adapter(&emul->adap);
+	irq_work_sync(&emul->int_work);
+	irq_free_desc(emul->irq);
+	mutex_destroy(&emul->lock);
+	kfree(emul);
+}
+
+static struct bq25898s_emul *bq25898s_emul_create(unsigned int id)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("bq25898s", BQ25898S_EMUL_ADDR),
+		.platform_data = &bq25898s_emul_pdata,
+	};
+	struct bq25898s_emul *emul;
+	int ret;
+
+	emul = kzalloc(sizeof(*emul), GFP_KERNEL);
+	if (!emul)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_init(&emul->lock);
+	spin_lock_init(&emul->int_lock);
+	init_irq_work(&emul->int_work, bq25898s_emul_int_work);
+	INIT_DELAYED_WORK(&emul->tick, bq25898s_emul_tick);
+	memcpy(emul->regs, bq25898s_emul_defaults, sizeof(emul->regs));
+	/* a battery at room temperature and nothing plugged in */
+	emul->vbat = 3800;
+	emul->ts_pct = 55000;
+	emul->rint = BQ25898S_EMUL_RINT;
+	emul->ambient = BQ25898S_EMUL_AMBIENT;
+	emul->speedup = 1;
+	emul->full = 100;
+	bq25898s_emul_new_run(emul, 0);
+
+	ret = bq25898s_emul_setup_irq(emul);
+	if (ret) {
+		mutex_destroy(&emul->lock);
+		kfree(emul);
+		return ERR_PTR(ret);
+	}
+
+	emul->adap.owner = THIS_MODULE;
+	emul->adap.algo = &bq25898s_emul_algo;
+	emul->rinfo.recover_bus = bq25898s_emul_recover_bus;
+	emul->adap.bus_recovery_info = &emul->rinfo;
+	snprintf(emul->adap.name, sizeof(emul->adap.name), "BQ25898S emulator");
+	i2c_set_adapdata(&emul->adap, emul);
+
+	ret = i2c_add_adapter(&emul->adap);
+	if (ret) {
+		irq_free_desc(emul->irq);
+		mutex_destroy(&emul->lock);
+		kfree(emul);
+		return ERR_PTR(ret);
+	}
+
+	bq25898s_emul_debugfs_init(emul);
+	schedule_delayed_work(&emul->tick, msecs_to_jiffies(BQ25898S_EMUL_TICK_MS));
+
+	/* the driver looks the gauge up by name, there is only one */
+	if (id == 0) {
+		emul->psy.name = "battery";
+		emul->psy.type = POWER_SUPPLY_TYPE_BATTERY;
+		emul->psy.properties = bq25898s_emul_battery_props;
+		emul->psy.num_properties = ARRAY_SIZE(bq25898s_emul_battery_props);
+		emul->psy.get_property = bq25898s_emul_battery_get_property;
+		ret = power_supply_register(&emul->adap.dev, &emul->psy);
+		if (ret) {
+			bq25898s_emul_destroy(emul);
+			return ERR_PTR(ret);
+		}
+		emul->psy_registered = true;
+	}
+
+	info.irq = emul->irq;
+	emul->client = i2c_new_device(&emul->adap, &info);
+	if (!emul->client) {
+		bq25898s_emul_destroy(emul);
+		return ERR_PTR(-ENODEV);
+	}
+
+	return emul;
+}
+
+static void bq25898s_emul_destroy_all(void)
+{
+	int i;
+
+	for (i = BQ25898S_EMUL_MAX - 1; i >= 0; i--) {
+		if (bq25898s_emul_dev[i])
+			bq25898s_emul_destroy(bq25898s_emul_dev[i]);
+		bq25898s_emul_dev[i] = NULL;
+	}
+}
+
+static int __init bq25898s_emul_init(void)
+{
+	struct bq25898s_emul *emul;
+	unsigned int i;
+
+	if (!instances || instances > BQ25898S_EMUL_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < instances; i++) {
+		emul = bq25898s_emul_create(i);
+		if (IS_ERR(emul)) {
+			pr_err("%s:failed to create emulator %u:%ld\n", __func__, i, PTR_ERR(emul));
+			bq25898s_emul_destroy_all();
+			return PTR_ERR(emul);
+		}
+		bq25898s_emul_dev[i] = emul;
+	}
+
+	return 0;
+}
+module_init(bq25898s_emul_init);
+
+static void __exit bq25898s_emul_cleanup(void)
+{
+	bq25898s_emul_destroy_all();
+}
+module_exit(bq25898s_emul_cleanup);
+
+MODULE_DESCRIPTION("TI BQ25898S chip model for testing the slave charger driver");
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Texas Instruments");
@@ -26,7 +26,7 @@
 #define BQ25898S_REG_02              	0x02
 #define BQ25898S_CONV_START_MASK     	0x80
 #define BQ25898S_CONV_START_SHIFT    	7
-#define BQ25898S_CONV_START          	0
+#define BQ25898S_CONV_START          	1
 #define BQ25898S_CONV_RATE_MASK       	0x40
 #define BQ25898S_CONV_RATE_SHIFT      	6
 #define BQ25898S_ADC_CONTINUE_ENABLE  	1
@@ -141,6 +141,10 @@
 #define BQ25898S_TMR2X_EN_SHIFT      6
 #define BQ25898S_TMR2X_ENABLE		 1
 #define BQ25898S_TMR2X_DISABLE		 0
+#define BQ25898S_FORCE_ICO_MASK      0x80
+#define BQ25898S_FORCE_ICO_SHIFT     7
+#define BQ25898S_PUMPX_MASK          0x03
+#define BQ25898S_PUMPX_SHIFT         0
 
 /* Register 0x0A*/
 #define BQ25898S_REG_0A              0x0A
@@ -209,6 +213,14 @@
 #define BQ25898S_SYSV_LSB            20
 
 
+/* Register 0x10*/
+#define BQ25898S_REG_10              0x10
+#define BQ25898S_TSPCT_MASK          0x7F
+#define BQ25898S_TSPCT_SHIFT         0
+#define BQ25898S_TSPCT_BASE          21000	/* 0.001% of REGN */
+#define BQ25898S_TSPCT_LSB           465
+
+
 /* Register 0x11*/
 #define BQ25898S_REG_11              0x11
 #define BQ25898S_VBUS_GD_MASK        0x80
@@ -249,4 +261,6 @@
 #define BQ25898S_DEV_REV_MASK        0x03
 #define BQ25898S_DEV_REV_SHIFT       0
 
+#define BQ25898S_REG_NUM             0x15
+
 #endif
@@ -24,7 +24,18 @@
 #include <linux/kthread.h>
 #include <linux/delay.h>
 #include <linux/of_gpio.h>
+#include <linux/ktime.h>
+#include <linux/seqlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
+#include <linux/thermal.h>
+#include <linux/kref.h>
 #include "bq25898s_reg.h"
+#include "bq25898s_slave.h"
+
+#define CREATE_TRACE_POINTS
+#include "bq25898s_trace.h"
 
 enum bq2589x_part_no {
 	BQ25898  = 0x00,
@@ -33,6 +44,39 @@ enum bq2589x_part_no {
 };
 
 
+/* up to this many ti,bq2589x,step-charge entries */
+#define BQ2589X_STEP_MAX	8
+
+struct bq2589x_step {
+	int	vbat;	/* mV, entry applies from here up */
+	int	ichg;	/* mA */
+};
+
+/* cooling states, ti,bq2589x,thermal-mitigation holds one pair per state */
+#define BQ2589X_THERMAL_MAX	8
+
+struct bq2589x_thermal_level {
+	int	ichg;	/* mA, negative for no limit */
+	int	iinlim;	/* mA, negative for no limit */
+};
+
+/* target contents for a set of register fields, applied in one go */
+struct bq2589x_reg_image {
+	u8	val[BQ25898S_REG_NUM];
+	u8	mask[BQ25898S_REG_NUM];
+};
+
+/* up to this many ti,bq2589x,jeita-zones entries */
+#define BQ2589X_JEITA_MAX	6
+
+struct bq2589x_jeita_zone {
+	int	ts_min;	/* TS in 0.001% of REGN, a colder battery reads higher */
+	int	ts_max;
+	int	vreg;	/* mV, never above the DT charge voltage */
+	int	ichg;	/* mA */
+	struct	bq2589x_reg_image img;	/* VREG and ICHG of the zone */
+};
+
 struct bq2589x_config {
 	bool	enable_auto_dpdm;
 
@@ -46,8 +90,128 @@ struct bq2589x_config {
 	int		term_current;
 
 	bool	use_absolute_vindpm;
+
+	int		aicl_max_current;	/* 0 keeps the input limit static */
+	int		share_pct;		/* slave part of a shared total */
+
+	/* replaces charge_current when present, ascending vbat */
+	struct	bq2589x_step step[BQ2589X_STEP_MAX];
+	int		step_num;
+
+	struct	bq2589x_thermal_level thermal[BQ2589X_THERMAL_MAX];
+	int		thermal_levels;
+
+	struct	bq2589x_jeita_zone jeita[BQ2589X_JEITA_MAX];
+	int		jeita_num;
+};
+
+/*
+ * Everything that wants to limit the charge current casts a vote, the
+ * lowest one is programmed. A negative vote means no opinion.
+ */
+enum bq2589x_ichg_voter {
+	BQ2589X_ICHG_VOTE_DT,		/* ti,bq2589x,charge-current */
+	BQ2589X_ICHG_VOTE_SHARE,	/* bq2589x_request_total_current() */
+	BQ2589X_ICHG_VOTE_STEP,		/* ti,bq2589x,step-charge */
+	BQ2589X_ICHG_VOTE_THERMAL,	/* cooling device */
+	BQ2589X_ICHG_VOTE_JEITA,	/* ti,bq2589x,jeita-zones */
+	BQ2589X_ICHG_VOTERS,
+};
+
+
+/* log2 buckets of the transaction time in us, the last one is open ended */
+#define BQ2589X_LAT_BUCKETS	16
+
+/* bus traffic accounting, protected by i2c_lock */
+struct bq2589x_xfer_stats {
+	u32	reads[BQ25898S_REG_NUM];
+	u32	writes[BQ25898S_REG_NUM];
+	u32	errors[BQ25898S_REG_NUM];
+	u32	hist[BQ2589X_LAT_BUCKETS];
+	u64	xfers;
+	u64	bytes;
+	u64	total_ns;
+	u64	max_ns;
+
+	/* failed attempts by class, including ones that were retried */
+	u32	err_nak;
+	u32	err_timeout;
+	u32	err_arb;
+	u32	err_other;
+	u32	retries;
+	u32	recovered;	/* transfers that succeeded after a retry */
+	u32	recoveries;
+	u32	recovery_failed;
+};
+
+/* driver operations whose bus cost is accounted, see bq2589x_op_begin() */
+enum bq2589x_op {
+	BQ2589X_OP_PROBE,
+	BQ2589X_OP_ADAPTER_IN,
+	BQ2589X_OP_ADAPTER_OUT,
+	BQ2589X_OP_MONITOR,
+	BQ2589X_OP_IRQ,
+	BQ2589X_OP_DUMP,
+	BQ2589X_OP_NUM,
+};
+
+/* protected by i2c_lock */
+struct bq2589x_op_stats {
+	u64	count;
+	u64	xfers;
+	u64	bytes;
+	u64	bus_ns;
+	u64	wall_ns;
+	u64	max_ns;
+};
+
+/*
+ * Operations in flight at once: the state machine, the IRQ thread and the
+ * register dump readers. One started while all slots are taken still has
+ * its count and wall time kept, but its bus traffic goes unaccounted.
+ */
+#define BQ2589X_OP_SLOTS	8
+
+/* protected by i2c_lock, free while task is NULL */
+struct bq2589x_op_slot {
+	struct task_struct	*task;
+	enum bq2589x_op		op;
 };
 
+/* one adapter attach, from plug-in to removal; protected by session_lock */
+struct bq2589x_session {
+	bool	active;
+	ktime_t	start;		/* boottime, sessions span suspend */
+	ktime_t	last;		/* last monitor sample */
+	s64	time_to_full;	/* ms, negative until done */
+	int	vbat_start;	/* mV, 0 until the first sample */
+	int	ichg_max;	/* mA */
+	int	ts_min;		/* 0.001%, the hottest TS seen */
+	u64	charge;		/* mA * ms of measured ICHGR */
+	u32	vdpm_events;
+	u32	idpm_events;
+	u32	thermal_events;
+	u32	faults;
+	bool	vdpm;
+	bool	idpm;
+};
+
+enum bq2589x_chg_state {
+	BQ2589X_STATE_ABSENT,		/* no adapter, slave disabled */
+	BQ2589X_STATE_PRECHG_WAIT,	/* held off until the battery leaves precharge */
+	BQ2589X_STATE_FAST,
+	BQ2589X_STATE_DONE,
+	BQ2589X_STATE_FAULT,
+	BQ2589X_STATE_THERMAL_LIMIT,	/* charging, chip in thermal regulation */
+};
+
+/* pending state machine events, see bq2589x_event_workfunc() */
+#define BQ2589X_EVT_ADAPTER	BIT(0)
+#define BQ2589X_EVT_IRQ		BIT(1)
+#define BQ2589X_EVT_POLL	BIT(2)
+#define BQ2589X_EVT_BATTERY	BIT(3)
+#define BQ2589X_EVT_SHARE	BIT(4)
+#define BQ2589X_EVT_THERMAL	BIT(5)
 
 struct bq2589x {
 	struct device *dev;
@@ -55,826 +219,3501 @@ struct bq2589x {
 	enum   bq2589x_part_no part_no;
 	int    revision;
 
-	bool	prechg;
+	enum	bq2589x_chg_state state;	/* only changed by the state machine */
+	struct	bq2589x_reg_image profile;	/* built from cfg by bq2589x_apply_config */
+	unsigned int	monitor_interval;	/* ms */
+	int	vindpm;		/* mV, as programmed */
+	int	ichg;		/* mA, as programmed */
+	int	iinlim;		/* mA, as programmed */
+	int	ichg_votes[BQ2589X_ICHG_VOTERS];
+	int	share_achieved;	/* mA, see bq2589x_get_current_share() */
+	int	step_idx;
+	struct	thermal_cooling_device *cdev;
+	unsigned long	thermal_cur;	/* cooling state in effect */
+	int	thermal_iinlim;
+	int	jeita_zone;	/* index, negative outside all zones */
+	int	jeita_vreg;	/* mV, negative for the DT charge voltage */
+	unsigned long	step_stamp;	/* jiffies of the last step change */
+
+	/* adaptive input current limit, see bq2589x_aicl_step() */
+	int	aicl_limit;	/* mA, as programmed */
+	int	aicl_ceiling;	/* mA, highest limit the adapter may get */
+	int	aicl_step;
+	int	aicl_hold;
 	struct	bq2589x_config	cfg;
-	struct 	work_struct irq_work;
-	struct 	delayed_work monitor_work;
+	struct	workqueue_struct *wq;		/* ordered, runs every work item below */
+	struct	work_struct event_work;
+	struct 	delayed_work monitor_work;		/* while the watchdog is armed */
+	struct	delayed_work monitor_idle_work;		/* deferrable, otherwise */
 
+	/* interrupt to end-of-thread latency, in us */
+	ktime_t	irq_stamp;
+	u32	irq_count;
+	s64	irq_latency_last;
+	s64	irq_latency_max;
+	s64	irq_latency_total;
 
-	int 	rsoc;
-	struct 	power_supply *batt_psy;
 
+	int 	rsoc;	/* last reported battery capacity, -1 until known */
+	struct 	power_supply *batt_psy;
+	struct	notifier_block batt_nb;
+	struct	power_supply psy;
+
+	struct	mutex i2c_lock;
+	struct	mutex adc_lock;
+	int	adc_users;	/* continuous conversion while non-zero */
+	bool	monitor_active;
+	struct	list_head list;
+	struct	kref ref;	/* probe's, plus one per bq2589x_find_by_node() */
+	int	irq_gpio;	/* no interrupt at all if client->irq stays 0 */
+	bool	block_io;	/* adapter does I2C block transfers */
+
+	/*
+	 * Pending events and the adapter state requested through
+	 * bq2589x_adapter_notify(); only the latest request is kept.
+	 */
+	spinlock_t	req_lock;
+	bool	stopping;	/* set by bq2589x_sm_stop(), nothing is queued after */
+	unsigned long	events;
+	bool	req_present;
+	int	req_total;	/* shared charge current, negative if none */
+	unsigned long	req_thermal;	/* cooling state asked for */
+	u8	irq_status;	/* see bq2589x_post_status() */
+	u8	irq_fault;	/* faults latched since the last event, ORed */
+	bq2589x_adapter_cb_t	req_cb;
+	void	*req_data;
+
+	/* latest decoded telemetry, readable without touching the bus */
+	seqlock_t	tlm_lock;
+	struct	bq2589x_telemetry tlm;
+
+	struct	bq2589x_xfer_stats xfer_stats;
+	int	xfer_fail_seq;	/* transfers in a row that failed on the bus */
+	struct	bq2589x_op_stats op_stats[BQ2589X_OP_NUM];
+	struct	mutex session_lock;
+	struct	bq2589x_session session;	/* current or last one */
+	struct	bq2589x_op_slot op_slots[BQ2589X_OP_SLOTS];
+	struct	dentry *debugfs;
+
+	/* shadow copy of the control registers, see bq2589x_reg_cacheable() */
+	u8		regs[BQ25898S_REG_NUM];
+	unsigned long	regs_valid;
 };
 
 
-static struct bq2589x *g_bq;
+/*
+ * The slave isn't needed once the battery is nearly full; it is turned back
+ * on when the capacity has dropped a few percent below that.
+ */
+#define BQ2589X_RSOC_FULL		95
+#define BQ2589X_RSOC_RESUME		92
 
-static DEFINE_MUTEX(bq2589x_i2c_lock);
+/*
+ * Adaptive input current: the step size halves on every back-off, and after
+ * one the limit is held for a few polls before it may go up again.
+ */
+#define BQ2589X_AICL_MIN_MA		500
+#define BQ2589X_AICL_STEP_MAX		400
+#define BQ2589X_AICL_STEP_MIN		50
+#define BQ2589X_AICL_HOLD		3
 
-static int bq2589x_read_byte(struct bq2589x *bq, u8 *data, u8 reg)
-{
-	int ret;
+/*
+ * Step charging moves at most one entry per interval, and only steps back
+ * once VBAT fell this far below the entry, as it drops with the current.
+ */
+#define BQ2589X_STEP_MIN_MS		30000
+#define BQ2589X_STEP_HYST		100
 
-	mutex_lock(&bq2589x_i2c_lock);
-	ret = i2c_smbus_read_byte_data(bq->client, reg);
-	if (ret < 0) {
-		dev_err(bq->dev, "failed to read 0x%.2x\n", reg);
-		mutex_unlock(&bq2589x_i2c_lock);
-		return ret;
-	}
+/* TS has to leave a JEITA zone by this much, in 0.001% */
+#define BQ2589X_JEITA_HYST		1000
 
-	*data = (u8)ret;
-	mutex_unlock(&bq2589x_i2c_lock);
+/* in thermal regulation the share may run this far above the measured ICHG */
+#define BQ2589X_SHARE_MARGIN		256	/* mA */
 
-	return 0;
-}
+/* VBUS has to move this far before VINDPM follows it */
+#define BQ2589X_VINDPM_HYST		200
 
-static int bq2589x_write_byte(struct bq2589x *bq, u8 reg, u8 data)
-{
-	int ret;
-	mutex_lock(&bq2589x_i2c_lock);
-	ret = i2c_smbus_write_byte_data(bq->client, reg, data);
-	mutex_unlock(&bq2589x_i2c_lock);
-	return ret;
-}
+/* slave charging is held off until the battery leaves precharge */
+#define BQ2589X_PRECHG_VOLT		3500
+#define BQ2589X_PRECHG_WINDOW		100
 
-static int bq2589x_update_bits(struct bq2589x *bq, u8 reg, u8 mask, u8 data)
-{
-	int ret;
-	u8 tmp;
+/*
+ * Monitor poll intervals. The slow interval has to stay below the 40s chip
+ * watchdog armed while charging.
+ */
+#define BQ2589X_MON_FAST_MS		2000
+#define BQ2589X_MON_NORMAL_MS		10000
+#define BQ2589X_MON_SLOW_MS		30000
+
+/*
+ * Bus retries: attempts after the first one, the initial backoff (doubled
+ * on every retry), and failed transfers in a row before bus recovery.
+ */
+#define BQ2589X_XFER_RETRIES		3
+#define BQ2589X_XFER_BACKOFF_US		500
+#define BQ2589X_XFER_RECOVER_AFTER	3
 
-	ret = bq2589x_read_byte(bq, &tmp, reg);
+/* one-shot ADC conversion: poll step and upper bound for CONV_START to clear */
+#define BQ2589X_ADC_POLL_MS		10
+#define BQ2589X_ADC_TIMEOUT_MS		1000
 
-	if (ret)
-		return ret;
+/* all probed slave chargers, each with its own bus lock */
+static LIST_HEAD(bq2589x_list);
+static DEFINE_MUTEX(bq2589x_list_lock);
+
+/*
+ * Bits that clear themselves once the chip has acted on them. They are never
+ * kept in the register cache and never written back as part of a
+ * read-modify-write of neighbouring bits.
+ */
+static const u8 bq2589x_volatile_bits[BQ25898S_REG_NUM] = {
+	[BQ25898S_REG_02] = BQ25898S_CONV_START_MASK | BQ25898S_FORCE_DPDM_MASK,
+	[BQ25898S_REG_03] = BQ25898S_WDT_RESET_MASK,
+	[BQ25898S_REG_09] = BQ25898S_FORCE_ICO_MASK | BQ25898S_PUMPX_MASK,
+	[BQ25898S_REG_14] = BQ25898S_RESET_MASK,
+};
 
-	tmp &= ~mask;
-	tmp |= data & mask;
+struct bq2589x_field {
+	u8	reg;
+	u8	mask;
+	u8	shift;
+	int	base;
+	int	lsb;
+	int	min;
+	int	max;
+};
 
-	return bq2589x_write_byte(bq, reg, tmp);
+/* linear field, values are clamped to [_min, _max] before encoding */
+#define BQ2589X_FIELD(_reg, _f, _min, _max) {			\
+	.reg	= BQ25898S_REG_##_reg,					\
+	.mask	= BQ25898S_##_f##_MASK,					\
+	.shift	= BQ25898S_##_f##_SHIFT,				\
+	.base	= BQ25898S_##_f##_BASE,					\
+	.lsb	= BQ25898S_##_f##_LSB,					\
+	.min	= _min,							\
+	.max	= _max,							\
 }
 
+/* linear field covering the whole code range, e.g. an ADC result */
+#define BQ2589X_FIELD_FULL(_reg, _f)					\
+	BQ2589X_FIELD(_reg, _f, BQ25898S_##_f##_BASE,			\
+		BQ25898S_##_f##_BASE + (BQ25898S_##_f##_MASK >> BQ25898S_##_f##_SHIFT) * BQ25898S_##_f##_LSB)
+
+/* single bits and enumerations, the value is the raw field content */
+#define BQ2589X_FIELD_RAW(_reg, _f) {					\
+	.reg	= BQ25898S_REG_##_reg,					\
+	.mask	= BQ25898S_##_f##_MASK,					\
+	.shift	= BQ25898S_##_f##_SHIFT,				\
+	.base	= 0,							\
+	.lsb	= 1,							\
+	.min	= 0,							\
+	.max	= BQ25898S_##_f##_MASK >> BQ25898S_##_f##_SHIFT,	\
+}
 
+static const struct bq2589x_field bq2589x_fields[BQ2589X_F_MAX_FIELDS] = {
+	[BQ2589X_F_EN_HIZ]	= BQ2589X_FIELD_RAW(00, ENHIZ),
+	[BQ2589X_F_IINLIM]	= BQ2589X_FIELD(00, IINLIM, 100, 3250),
+	[BQ2589X_F_VINDPM_OS]	= BQ2589X_FIELD_RAW(01, VINDPMOS),
+	[BQ2589X_F_CONV_RATE]	= BQ2589X_FIELD_RAW(02, CONV_RATE),
+	[BQ2589X_F_AUTO_DPDM_EN] = BQ2589X_FIELD_RAW(02, AUTO_DPDM_EN),
+	[BQ2589X_F_CHG_CONFIG]	= BQ2589X_FIELD_RAW(03, CHG_CONFIG),
+	[BQ2589X_F_ICHG]	= BQ2589X_FIELD(04, ICHG, 0, 4032),
+	[BQ2589X_F_IPRECHG]	= BQ2589X_FIELD(05, IPRECHG, 64, 1024),
+	[BQ2589X_F_ITERM]	= BQ2589X_FIELD(05, ITERM, 64, 1024),
+	[BQ2589X_F_VREG]	= BQ2589X_FIELD(06, VREG, 3840, 4608),
+	[BQ2589X_F_BATLOWV]	= BQ2589X_FIELD_RAW(06, BATLOWV),
+	[BQ2589X_F_VRECHG]	= BQ2589X_FIELD_RAW(06, VRECHG),
+	[BQ2589X_F_EN_TERM]	= BQ2589X_FIELD_RAW(07, EN_TERM),
+	[BQ2589X_F_WDT]		= BQ2589X_FIELD_RAW(07, WDT),
+	[BQ2589X_F_EN_TIMER]	= BQ2589X_FIELD_RAW(07, EN_TIMER),
+	[BQ2589X_F_CHG_TIMER]	= BQ2589X_FIELD_RAW(07, CHG_TIMER),
+	[BQ2589X_F_BAT_COMP]	= BQ2589X_FIELD(08, BAT_COMP, 0, 140),
+	[BQ2589X_F_VCLAMP]	= BQ2589X_FIELD(08, VCLAMP, 0, 224),
+	[BQ2589X_F_TREG]	= BQ2589X_FIELD_RAW(08, TREG),
+	[BQ2589X_F_TMR2X_EN]	= BQ2589X_FIELD_RAW(09, TMR2X_EN),
+	[BQ2589X_F_FORCE_VINDPM] = BQ2589X_FIELD_RAW(0D, FORCE_VINDPM),
+	[BQ2589X_F_VINDPM]	= BQ2589X_FIELD(0D, VINDPM, 3900, 15300),
+	[BQ2589X_F_THERM_STAT]	= BQ2589X_FIELD_RAW(0E, THERM_STAT),
+	[BQ2589X_F_BATV]	= BQ2589X_FIELD_FULL(0E, BATV),
+	[BQ2589X_F_SYSV]	= BQ2589X_FIELD_FULL(0F, SYSV),
+	[BQ2589X_F_TSPCT]	= BQ2589X_FIELD_FULL(10, TSPCT),
+	[BQ2589X_F_VBUS_GD]	= BQ2589X_FIELD_RAW(11, VBUS_GD),
+	[BQ2589X_F_VBUSV]	= BQ2589X_FIELD_FULL(11, VBUSV),
+	[BQ2589X_F_ICHGR]	= BQ2589X_FIELD_FULL(12, ICHGR),
+	[BQ2589X_F_VDPM_STAT]	= BQ2589X_FIELD_RAW(13, VDPM_STAT),
+	[BQ2589X_F_IDPM_STAT]	= BQ2589X_FIELD_RAW(13, IDPM_STAT),
+	[BQ2589X_F_IDPM_LIM]	= BQ2589X_FIELD_FULL(13, IDPM_LIM),
+};
 
-static int bq2589x_enable_charger(struct bq2589x *bq)
+/* clamp @val into the field range and return it positioned in the register */
+static u8 bq2589x_field_encode(enum bq2589x_field_id id, int val)
 {
-	int ret;
-	u8 val = BQ25898S_CHG_ENABLE << BQ25898S_CHG_CONFIG_SHIFT;
+	const struct bq2589x_field *f = &bq2589x_fields[id];
+	int code;
 
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_03, BQ25898S_CHG_CONFIG_MASK, val);
-	return ret;
+	val = clamp(val, f->min, f->max);
+	code = (val - f->base) / f->lsb;
+	code = clamp(code, 0, f->mask >> f->shift);
+
+	return code << f->shift;
 }
-EXPORT_SYMBOL_GPL(bq2589x_enable_charger);
 
-static int bq2589x_disable_charger(struct bq2589x *bq)
+static int bq2589x_field_decode(enum bq2589x_field_id id, u8 regval)
 {
-	int ret;
-	u8 val = BQ25898S_CHG_DISABLE << BQ25898S_CHG_CONFIG_SHIFT;
+	const struct bq2589x_field *f = &bq2589x_fields[id];
 
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_03, BQ25898S_CHG_CONFIG_MASK, val);
-	return ret;
+	return f->base + ((regval & f->mask) >> f->shift) * f->lsb;
 }
-EXPORT_SYMBOL_GPL(bq2589x_disable_charger);
 
-static int bq2589x_enable_term(struct bq2589x* bq, bool enable)
+/* control registers 0x00-0x0A and 0x0D only change when we write them */
+static bool bq2589x_reg_cacheable(u8 reg)
 {
-	u8 val;
-	int ret;
+	return reg <= BQ25898S_REG_0A || reg == BQ25898S_REG_0D;
+}
 
-	if (enable)
-		val = BQ25898S_TERM_ENABLE << BQ25898S_EN_TERM_SHIFT;
-	else
-		val = BQ25898S_TERM_DISABLE << BQ25898S_EN_TERM_SHIFT;
+static bool bq2589x_reg_cached(struct bq2589x *bq, u8 reg)
+{
+	if (!bq2589x_reg_cacheable(reg) || !(bq->regs_valid & BIT(reg)))
+		return false;
 
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_07, BQ25898S_EN_TERM_MASK, val);
+	/* VINDPM is owned by the chip unless absolute mode is forced */
+	if (reg == BQ25898S_REG_0D && !(bq->regs[reg] & BQ25898S_FORCE_VINDPM_MASK))
+		return false;
 
-	return ret;
+	return true;
 }
-EXPORT_SYMBOL_GPL(bq2589x_enable_term);
 
-
-int bq2589x_adc_start(struct bq2589x *bq, bool oneshot)
+static void bq2589x_cache_store(struct bq2589x *bq, u8 reg, u8 val)
 {
-	u8 val;
-	int ret;
-
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_02);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s failed to read register 0x02:%d\n", __func__, ret);
-		return ret;
-	}
+	if (!bq2589x_reg_cacheable(reg))
+		return;
 
-	if (((val & BQ25898S_CONV_RATE_MASK) >> BQ25898S_CONV_RATE_SHIFT) == BQ25898S_ADC_CONTINUE_ENABLE)
-		return 0; /*is doing continuous scan*/
-	if (oneshot)
-		ret = bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_CONV_START_MASK, BQ25898S_CONV_START << BQ25898S_CONV_START_SHIFT);
-	else
-		ret = bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_CONV_RATE_MASK,  BQ25898S_ADC_CONTINUE_ENABLE << BQ25898S_CONV_RATE_SHIFT);
-	return ret;
+	bq->regs[reg] = val & ~bq2589x_volatile_bits[reg];
+	bq->regs_valid |= BIT(reg);
 }
-EXPORT_SYMBOL_GPL(bq2589x_adc_start);
 
-int bq2589x_adc_stop(struct bq2589x *bq)
+/*
+ * Drop the whole cache, e.g. after a chip reset or a watchdog expiry which
+ * restores the control registers to their power-on defaults.
+ */
+static void bq2589x_cache_invalidate(struct bq2589x *bq)
 {
-	return bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_CONV_RATE_MASK, BQ25898S_ADC_CONTINUE_DISABLE << BQ25898S_CONV_RATE_SHIFT);
+	mutex_lock(&bq->i2c_lock);
+	bq->regs_valid = 0;
+	mutex_unlock(&bq->i2c_lock);
 }
-EXPORT_SYMBOL_GPL(bq2589x_adc_stop);
 
-
-int bq2589x_adc_read_battery_volt(struct bq2589x *bq)
+/* account and trace one bus transaction, called with i2c_lock held */
+static void bq2589x_xfer_done(struct bq2589x *bq, u8 reg, u8 len, u8 val,
+				bool write, ktime_t start, int err)
 {
-	uint8_t val;
-	int volt;
-	int ret;
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0E);
-	if (ret < 0) {
-		dev_err(bq->dev, "read battery voltage failed :%d\n", ret);
-		return ret;
-	} else{
-		volt = BQ25898S_BATV_BASE + ((val & BQ25898S_BATV_MASK) >> BQ25898S_BATV_SHIFT) * BQ25898S_BATV_LSB ;
-		return volt;
+	struct bq2589x_xfer_stats *st = &bq->xfer_stats;
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 us = div_u64(ns, 1000);
+	int bucket = 0;
+	int slot;
+	u8 i;
+
+	trace_bq2589x_i2c_xfer(bq->dev, reg, len, val, write, ns, err);
+
+	for (slot = 0; slot < BQ2589X_OP_SLOTS; slot++) {
+		struct bq2589x_op_stats *ops;
+
+		if (bq->op_slots[slot].task != current)
+			continue;
+		ops = &bq->op_stats[bq->op_slots[slot].op];
+		ops->xfers++;
+		ops->bus_ns += ns;
+		if (err >= 0)
+			ops->bytes += len;
 	}
-}
-EXPORT_SYMBOL_GPL(bq2589x_adc_read_battery_volt);
 
+	if (us)
+		bucket = min_t(int, ilog2(us) + 1, BQ2589X_LAT_BUCKETS - 1);
+	st->hist[bucket]++;
+	st->xfers++;
+	st->total_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
 
-int bq2589x_adc_read_sys_volt(struct bq2589x *bq)
-{
-	uint8_t val;
-	int volt;
-	int ret;
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0F);
-	if (ret < 0) {
-		dev_err(bq->dev, "read system voltage failed :%d\n", ret);
-		return ret;
-	} else{
-		volt = BQ25898S_SYSV_BASE + ((val & BQ25898S_SYSV_MASK) >> BQ25898S_SYSV_SHIFT) * BQ25898S_SYSV_LSB ;
-		return volt;
+	if (err < 0) {
+		st->errors[reg]++;
+		return;
+	}
+
+	st->bytes += len;
+	for (i = reg; i < reg + len && i < BQ25898S_REG_NUM; i++) {
+		if (write)
+			st->writes[i]++;
+		else
+			st->reads[i]++;
 	}
 }
-EXPORT_SYMBOL_GPL(bq2589x_adc_read_sys_volt);
 
-int bq2589x_adc_read_vbus_volt(struct bq2589x *bq)
+/*
+ * Bus transfers issued by the calling task until bq2589x_op_end() are
+ * charged to @op. Work queued meanwhile runs in another task and is
+ * charged to its own operation, if any. Several tasks may run the same
+ * operation at once, e.g. two register dump readers, each gets a slot.
+ */
+static ktime_t bq2589x_op_begin(struct bq2589x *bq, enum bq2589x_op op)
 {
-	uint8_t val;
-	int volt;
-	int ret;
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_11);
-	if (ret < 0) {
-		dev_err(bq->dev, "read vbus voltage failed :%d\n", ret);
-		return ret;
-	} else{
-		volt = BQ25898S_VBUSV_BASE + ((val & BQ25898S_VBUSV_MASK) >> BQ25898S_VBUSV_SHIFT) * BQ25898S_VBUSV_LSB ;
-		return volt;
+	int slot;
+
+	mutex_lock(&bq->i2c_lock);
+	for (slot = 0; slot < BQ2589X_OP_SLOTS; slot++) {
+		if (!bq->op_slots[slot].task) {
+			bq->op_slots[slot].task = current;
+			bq->op_slots[slot].op = op;
+			break;
+		}
 	}
+	mutex_unlock(&bq->i2c_lock);
+
+	return ktime_get();
 }
-EXPORT_SYMBOL_GPL(bq2589x_adc_read_vbus_volt);
 
-int bq2589x_adc_read_charge_current(struct bq2589x *bq)
+static void bq2589x_op_end(struct bq2589x *bq, enum bq2589x_op op, ktime_t start)
 {
-	uint8_t val;
-	int volt;
-	int ret;
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_12);
-	if (ret < 0) {
-		dev_err(bq->dev, "read charge current failed :%d\n", ret);
-		return ret;
-	} else{
-		volt = (int)(BQ25898S_ICHGR_BASE + ((val & BQ25898S_ICHGR_MASK) >> BQ25898S_ICHGR_SHIFT) * BQ25898S_ICHGR_LSB) ;
-		return volt;
+	struct bq2589x_op_stats *st = &bq->op_stats[op];
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	int slot;
+
+	mutex_lock(&bq->i2c_lock);
+	for (slot = 0; slot < BQ2589X_OP_SLOTS; slot++) {
+		if (bq->op_slots[slot].task == current &&
+		    bq->op_slots[slot].op == op) {
+			bq->op_slots[slot].task = NULL;
+			break;
+		}
 	}
+	st->count++;
+	st->wall_ns += ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+	mutex_unlock(&bq->i2c_lock);
 }
-EXPORT_SYMBOL_GPL(bq2589x_adc_read_charge_current);
 
-int bq2589x_set_chargecurrent(struct bq2589x *bq, int curr)
+/*
+ * Adapters without I2C block support, e.g. a plain SMBus controller, get
+ * the block as a series of byte transfers. Accounted as one transaction.
+ */
+static s32 bq2589x_smbus_read_block(struct bq2589x *bq, u8 reg, u8 len, u8 *buf)
 {
-	u8 ichg;
+	s32 ret;
+	u8 i;
 
-	ichg = (curr - BQ25898S_ICHG_BASE)/BQ25898S_ICHG_LSB;
-	return bq2589x_update_bits(bq, BQ25898S_REG_04, BQ25898S_ICHG_MASK, ichg << BQ25898S_ICHG_SHIFT);
+	if (bq->block_io)
+		return i2c_smbus_read_i2c_block_data(bq->client, reg, len, buf);
 
+	for (i = 0; i < len; i++) {
+		ret = i2c_smbus_read_byte_data(bq->client, reg + i);
+		if (ret < 0)
+			return ret;
+		buf[i] = ret;
+	}
+
+	return len;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_chargecurrent);
 
-int bq2589x_set_term_current(struct bq2589x *bq, int curr)
+static s32 bq2589x_smbus_write_block(struct bq2589x *bq, u8 reg, u8 len, const u8 *buf)
 {
-	u8 iterm;
+	s32 ret;
+	u8 i;
 
-	iterm = (curr - BQ25898S_ITERM_BASE) / BQ25898S_ITERM_LSB;
+	if (bq->block_io)
+		return i2c_smbus_write_i2c_block_data(bq->client, reg, len, buf);
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_05, BQ25898S_ITERM_MASK, iterm << BQ25898S_ITERM_SHIFT);
+	for (i = 0; i < len; i++) {
+		ret = i2c_smbus_write_byte_data(bq->client, reg + i, buf[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_term_current);
 
+enum bq2589x_xfer_kind {
+	BQ2589X_XFER_READ_BYTE,
+	BQ2589X_XFER_WRITE_BYTE,
+	BQ2589X_XFER_READ_BLOCK,
+	BQ2589X_XFER_WRITE_BLOCK,
+};
 
-int bq2589x_set_prechg_current(struct bq2589x *bq, int curr)
+static s32 bq2589x_smbus_once(struct bq2589x *bq, enum bq2589x_xfer_kind kind,
+				u8 reg, u8 len, u8 *buf)
 {
-	u8 iprechg;
-
-	iprechg = (curr - BQ25898S_IPRECHG_BASE) / BQ25898S_IPRECHG_LSB;
+	s32 ret;
+
+	switch (kind) {
+	case BQ2589X_XFER_READ_BYTE:
+		return i2c_smbus_read_byte_data(bq->client, reg);
+	case BQ2589X_XFER_WRITE_BYTE:
+		return i2c_smbus_write_byte_data(bq->client, reg, buf[0]);
+	case BQ2589X_XFER_READ_BLOCK:
+		ret = bq2589x_smbus_read_block(bq, reg, len, buf);
+		if (ret >= 0 && ret != len)
+			ret = -EIO;
+		return ret;
+	case BQ2589X_XFER_WRITE_BLOCK:
+		return bq2589x_smbus_write_block(bq, reg, len, buf);
+	}
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_05, BQ25898S_IPRECHG_MASK, iprechg << BQ25898S_IPRECHG_SHIFT);
+	return -EINVAL;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_prechg_current);
 
-int bq2589x_set_chargevoltage(struct bq2589x *bq, int volt)
+/* NAKs and timeouts are the ones a stuck bus shows, see bq2589x_smbus_xfer() */
+static bool bq2589x_xfer_bus_error(s32 err)
 {
-	u8 val;
-
-	val = (volt - BQ25898S_VREG_BASE)/BQ25898S_VREG_LSB;
-	return bq2589x_update_bits(bq, BQ25898S_REG_06, BQ25898S_VREG_MASK, val << BQ25898S_VREG_SHIFT);
+	return err == -ENXIO || err == -EREMOTEIO || err == -ETIMEDOUT;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_chargevoltage);
 
-
-int bq2589x_set_input_volt_limit(struct bq2589x *bq, int volt)
+static void bq2589x_xfer_count_error(struct bq2589x *bq, s32 err)
 {
-	u8 val;
-	val = (volt - BQ25898S_VINDPM_BASE) / BQ25898S_VINDPM_LSB;
-	return bq2589x_update_bits(bq, BQ25898S_REG_0D, BQ25898S_VINDPM_MASK, val << BQ25898S_VINDPM_SHIFT);
+	struct bq2589x_xfer_stats *st = &bq->xfer_stats;
+
+	if (err == -ENXIO || err == -EREMOTEIO)
+		st->err_nak++;
+	else if (err == -ETIMEDOUT)
+		st->err_timeout++;
+	else if (err == -EAGAIN)
+		st->err_arb++;
+	else
+		st->err_other++;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_input_volt_limit);
 
-int bq2589x_set_input_current_limit(struct bq2589x *bq, int curr)
+/*
+ * Recovery toggles SCL on the physical bus, which other devices share, e.g.
+ * the fuel gauge or the master charger. Only do it between their
+ * transfers, holding the root adapter's bus lock as an adapter driver would.
+ */
+static int bq2589x_recover_bus(struct bq2589x *bq)
 {
-	u8 val;
+	struct i2c_adapter *adap = bq->client->adapter;
+	struct i2c_adapter *parent;
+	int ret;
 
-	val = (curr - BQ25898S_IINLIM_BASE) / BQ25898S_IINLIM_LSB;
-	return bq2589x_update_bits(bq, BQ25898S_REG_00, BQ25898S_IINLIM_MASK, val << BQ25898S_IINLIM_SHIFT);
-}
-EXPORT_SYMBOL_GPL(bq2589x_set_input_current_limit);
+	/* a mux segment has no recovery of its own */
+	while ((parent = i2c_parent_is_i2c_adapter(adap)))
+		adap = parent;
 
+	i2c_lock_adapter(adap);
+	ret = i2c_recover_bus(adap);
+	i2c_unlock_adapter(adap);
 
-int bq2589x_set_vindpm_offset(struct bq2589x *bq, int offset)
+	return ret;
+}
+
+/*
+ * Every bus access ends up here, with i2c_lock held. Transient failures on
+ * the shared bus are retried with exponential backoff; if transfers keep
+ * failing with NAKs or timeouts the adapter is asked to recover the bus,
+ * e.g. by clocking out a slave stuck in the middle of a byte.
+ */
+static s32 bq2589x_smbus_xfer(struct bq2589x *bq, enum bq2589x_xfer_kind kind,
+				u8 reg, u8 len, u8 *buf)
 {
-	u8 val;
+	struct bq2589x_xfer_stats *st = &bq->xfer_stats;
+	unsigned int delay = BQ2589X_XFER_BACKOFF_US;
+	int try;
+	s32 ret;
+
+	for (try = 0; ; try++) {
+		ret = bq2589x_smbus_once(bq, kind, reg, len, buf);
+		if (ret >= 0) {
+			if (try)
+				st->recovered++;
+			bq->xfer_fail_seq = 0;
+			return ret;
+		}
 
-	if (offset == 400)
-		val = BQ25898S_VINDPMOS_400MV;
-	else
-		val = BQ25898S_VINDPMOS_600MV;
+		bq2589x_xfer_count_error(bq, ret);
+		if (try == BQ2589X_XFER_RETRIES || ret == -EINVAL || ret == -EOPNOTSUPP)
+			break;
+
+		st->retries++;
+		usleep_range(delay, delay * 2);
+		delay *= 2;
+	}
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_01, BQ25898S_VINDPMOS_MASK, val << BQ25898S_VINDPMOS_SHIFT);
+	if (bq2589x_xfer_bus_error(ret) && ++bq->xfer_fail_seq >= BQ2589X_XFER_RECOVER_AFTER) {
+		bq->xfer_fail_seq = 0;
+		st->recoveries++;
+		if (bq2589x_recover_bus(bq)) {
+			st->recovery_failed++;
+			dev_err(bq->dev, "%s:bus recovery failed\n", __func__);
+		} else {
+			dev_info(bq->dev, "%s:bus recovered\n", __func__);
+		}
+	}
 
+	return ret;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_vindpm_offset);
 
-int bq2589x_get_charging_status(struct bq2589x *bq)
+static int __bq2589x_read_byte(struct bq2589x *bq, u8 *data, u8 reg)
 {
-	u8 val = 0;
+	ktime_t start = ktime_get();
 	int ret;
 
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0B);
+	ret = bq2589x_smbus_xfer(bq, BQ2589X_XFER_READ_BYTE, reg, 1, NULL);
+	bq2589x_xfer_done(bq, reg, 1, ret < 0 ? 0 : ret, false, start, ret);
 	if (ret < 0) {
-		dev_err(bq->dev, "%s Failed to read register 0x0b:%d\n", __func__, ret);
+		dev_err(bq->dev, "failed to read 0x%.2x\n", reg);
 		return ret;
 	}
-	val &= BQ25898S_CHRG_STAT_MASK;
-	val >>= BQ25898S_CHRG_STAT_SHIFT;
-	return val;
-}
-EXPORT_SYMBOL_GPL(bq2589x_get_charging_status);
 
-int bq2589x_set_watchdog_timer(struct bq2589x *bq, u8 timeout)
-{
-	return bq2589x_update_bits(bq, BQ25898S_REG_07, BQ25898S_WDT_MASK, (u8)((timeout - BQ25898S_WDT_BASE) / BQ25898S_WDT_LSB) << BQ25898S_WDT_SHIFT);
+	*data = (u8)ret;
+	bq2589x_cache_store(bq, reg, *data);
+
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_watchdog_timer);
 
-int bq2589x_disable_watchdog_timer(struct bq2589x *bq)
+static int __bq2589x_write_byte(struct bq2589x *bq, u8 reg, u8 data)
 {
-	u8 val = BQ25898S_WDT_DISABLE << BQ25898S_WDT_SHIFT;
+	ktime_t start = ktime_get();
+	int ret;
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_07, BQ25898S_WDT_MASK, val);
-}
-EXPORT_SYMBOL_GPL(bq2589x_disable_watchdog_timer);
+	ret = bq2589x_smbus_xfer(bq, BQ2589X_XFER_WRITE_BYTE, reg, 1, &data);
+	bq2589x_xfer_done(bq, reg, 1, data, true, start, ret);
+	if (ret < 0) {
+		/* we no longer know what the chip holds */
+		bq->regs_valid &= ~BIT(reg);
+		return ret;
+	}
 
-int bq2589x_reset_watchdog_timer(struct bq2589x *bq)
-{
-	u8 val = BQ25898S_WDT_RESET << BQ25898S_WDT_RESET_SHIFT;
+	bq2589x_cache_store(bq, reg, data);
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_03, BQ25898S_WDT_RESET_MASK, val);
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_reset_watchdog_timer);
 
-int bq2589x_reset_chip(struct bq2589x *bq)
+static int __bq2589x_read_block(struct bq2589x *bq, u8 reg, u8 *buf, u8 len)
 {
+	ktime_t start = ktime_get();
 	int ret;
-	u8 val = BQ25898S_RESET << BQ25898S_RESET_SHIFT;
-
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_14, BQ25898S_RESET_MASK, val);
-	return ret;
-}
-EXPORT_SYMBOL_GPL(bq2589x_reset_chip);
+	u8 i;
 
-int bq2589x_enter_hiz_mode(struct bq2589x *bq)
-{
-	u8 val = BQ25898S_HIZ_ENABLE << BQ25898S_ENHIZ_SHIFT;
+	ret = bq2589x_smbus_xfer(bq, BQ2589X_XFER_READ_BLOCK, reg, len, buf);
+	bq2589x_xfer_done(bq, reg, len, ret < 0 ? 0 : buf[0], false, start, ret);
+	if (ret < 0) {
+		dev_err(bq->dev, "failed to read 0x%.2x-0x%.2x:%d\n", reg, reg + len - 1, ret);
+		return ret;
+	}
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_00, BQ25898S_ENHIZ_MASK, val);
+	for (i = 0; i < len; i++)
+		bq2589x_cache_store(bq, reg + i, buf[i]);
 
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_enter_hiz_mode);
 
-int bq2589x_exit_hiz_mode(struct bq2589x *bq)
+static int __bq2589x_write_block(struct bq2589x *bq, u8 reg, const u8 *buf, u8 len)
 {
+	ktime_t start = ktime_get();
+	int ret;
+	u8 i;
 
-	u8 val = BQ25898S_HIZ_DISABLE << BQ25898S_ENHIZ_SHIFT;
+	ret = bq2589x_smbus_xfer(bq, BQ2589X_XFER_WRITE_BLOCK, reg, len, (u8 *)buf);
+	bq2589x_xfer_done(bq, reg, len, buf[0], true, start, ret);
+	if (ret < 0) {
+		dev_err(bq->dev, "failed to write 0x%.2x-0x%.2x:%d\n", reg, reg + len - 1, ret);
+		for (i = 0; i < len; i++)
+			bq->regs_valid &= ~BIT(reg + i);
+		return ret;
+	}
 
-	return bq2589x_update_bits(bq, BQ25898S_REG_00, BQ25898S_ENHIZ_MASK, val);
+	for (i = 0; i < len; i++)
+		bq2589x_cache_store(bq, reg + i, buf[i]);
 
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_exit_hiz_mode);
 
-int bq2589x_get_hiz_mode(struct bq2589x *bq, u8 *state)
+static int bq2589x_read_byte(struct bq2589x *bq, u8 *data, u8 reg)
 {
-	u8 val;
 	int ret;
 
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_00);
-	if (ret)
-		return ret;
-	*state = (val & BQ25898S_ENHIZ_MASK) >> BQ25898S_ENHIZ_SHIFT;
+	mutex_lock(&bq->i2c_lock);
+	ret = __bq2589x_read_byte(bq, data, reg);
+	mutex_unlock(&bq->i2c_lock);
 
-	return 0;
+	return ret;
 }
-EXPORT_SYMBOL_GPL(bq2589x_get_hiz_mode);
-
 
-static int bq2589x_enable_auto_dpdm(struct bq2589x* bq, bool enable)
+static int bq2589x_read_block(struct bq2589x *bq, u8 reg, u8 *buf, u8 len)
 {
-	u8 val;
 	int ret;
-	
-	if (enable)
-		val = BQ25898S_AUTO_DPDM_ENABLE << BQ25898S_AUTO_DPDM_EN_SHIFT;
-	else
-		val = BQ25898S_AUTO_DPDM_DISABLE << BQ25898S_AUTO_DPDM_EN_SHIFT;
 
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_AUTO_DPDM_EN_MASK, val);
+	mutex_lock(&bq->i2c_lock);
+	ret = __bq2589x_read_block(bq, reg, buf, len);
+	mutex_unlock(&bq->i2c_lock);
 
 	return ret;
+}
 
+static void bq2589x_image_set(struct bq2589x_reg_image *img, u8 reg, u8 mask, u8 val)
+{
+	img->mask[reg] |= mask;
+	img->val[reg] &= ~mask;
+	img->val[reg] |= val & mask;
 }
-EXPORT_SYMBOL_GPL(bq2589x_enable_auto_dpdm);
 
-static int bq2589x_set_absolute_vindpm(struct bq2589x* bq, bool enable)
+static void bq2589x_image_set_field(struct bq2589x_reg_image *img,
+				enum bq2589x_field_id id, int val)
 {
-	u8 val;
+	const struct bq2589x_field *f = &bq2589x_fields[id];
+
+	bq2589x_image_set(img, f->reg, f->mask, bq2589x_field_encode(id, val));
+}
+
+/*
+ * Bring every register that @img only partially covers into the cache,
+ * reading adjacent registers with one block transaction.
+ */
+static int __bq2589x_cache_fill(struct bq2589x *bq, const struct bq2589x_reg_image *img)
+{
+	u8 buf[BQ25898S_REG_NUM];
+	u8 first, reg;
+	int ret;
+
+	for (reg = 0; reg < BQ25898S_REG_NUM; reg++) {
+		if (!img->mask[reg] || img->mask[reg] == 0xFF || bq2589x_reg_cached(bq, reg))
+			continue;
+
+		first = reg;
+		while (reg + 1 < BQ25898S_REG_NUM && img->mask[reg + 1] &&
+				img->mask[reg + 1] != 0xFF && !bq2589x_reg_cached(bq, reg + 1))
+			reg++;
+
+		if (reg == first)
+			ret = __bq2589x_read_byte(bq, buf, first);
+		else
+			ret = __bq2589x_read_block(bq, first, buf, reg - first + 1);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write the fields described by @img, touching only registers whose
+ * contents differ and merging adjacent ones into block writes.
+ * Returns the number of bytes sent to the chip or a negative error.
+ */
+static int bq2589x_apply_image(struct bq2589x *bq, const struct bq2589x_reg_image *img)
+{
+	u8 buf[BQ25898S_REG_NUM];
+	unsigned long dirty = 0;
+	int bytes = 0;
+	u8 first, reg, cur;
 	int ret;
 
-	if (enable)
-		val = BQ25898S_FORCE_VINDPM_ENABLE << BQ25898S_FORCE_VINDPM_SHIFT;
+	mutex_lock(&bq->i2c_lock);
+
+	ret = __bq2589x_cache_fill(bq, img);
+	if (ret)
+		goto out;
+
+	for (reg = 0; reg < BQ25898S_REG_NUM; reg++) {
+		if (!img->mask[reg])
+			continue;
+
+		if (!bq2589x_reg_cached(bq, reg)) {
+			/* fully covered and unknown, just write it */
+			buf[reg] = img->val[reg];
+			dirty |= BIT(reg);
+			continue;
+		}
+
+		cur = bq->regs[reg];
+		buf[reg] = (cur & ~img->mask[reg]) | (img->val[reg] & img->mask[reg]);
+		if (buf[reg] != cur)
+			dirty |= BIT(reg);
+	}
+
+	for (reg = 0; reg < BQ25898S_REG_NUM; reg++) {
+		if (!(dirty & BIT(reg)))
+			continue;
+
+		first = reg;
+		while (reg + 1 < BQ25898S_REG_NUM && (dirty & BIT(reg + 1)))
+			reg++;
+
+		if (reg == first)
+			ret = __bq2589x_write_byte(bq, first, buf[first]);
+		else
+			ret = __bq2589x_write_block(bq, first, &buf[first], reg - first + 1);
+		if (ret)
+			goto out;
+		bytes += reg - first + 1;
+	}
+out:
+	mutex_unlock(&bq->i2c_lock);
+	return ret ? ret : bytes;
+}
+
+/*
+ * Read-modify-write served from the register cache where possible: a cached
+ * register costs a single write, and an update which does not change the
+ * register contents costs no bus transaction at all.
+ */
+static int bq2589x_update_bits(struct bq2589x *bq, u8 reg, u8 mask, u8 data)
+{
+	int ret = 0;
+	u8 tmp, val;
+
+	mutex_lock(&bq->i2c_lock);
+
+	if (bq2589x_reg_cached(bq, reg)) {
+		tmp = bq->regs[reg];
+	} else {
+		ret = __bq2589x_read_byte(bq, &tmp, reg);
+		if (ret)
+			goto out;
+		tmp &= ~bq2589x_volatile_bits[reg];
+	}
+
+	val = tmp & ~mask;
+	val |= data & mask;
+
+	if (val != tmp)
+		ret = __bq2589x_write_byte(bq, reg, val);
+out:
+	mutex_unlock(&bq->i2c_lock);
+	return ret;
+}
+
+
+/* status and ADC fields are read only, writing them would hit those registers */
+static bool bq2589x_field_writable(enum bq2589x_field_id id)
+{
+	return (unsigned int)id < BQ2589X_F_THERM_STAT;
+}
+
+int bq2589x_field_read(struct bq2589x *bq, enum bq2589x_field_id id, int *val)
+{
+	const struct bq2589x_field *f;
+	u8 regval;
+	int ret = 0;
+
+	if ((unsigned int)id >= BQ2589X_F_MAX_FIELDS)
+		return -EINVAL;
+	f = &bq2589x_fields[id];
+
+	mutex_lock(&bq->i2c_lock);
+	if (bq2589x_reg_cached(bq, f->reg))
+		regval = bq->regs[f->reg];
 	else
-		val = BQ25898S_FORCE_VINDPM_DISABLE << BQ25898S_FORCE_VINDPM_SHIFT;
+		ret = __bq2589x_read_byte(bq, &regval, f->reg);
+	mutex_unlock(&bq->i2c_lock);
+
+	if (ret)
+		return ret;
+
+	*val = bq2589x_field_decode(id, regval);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_field_read);
+
+int bq2589x_field_write(struct bq2589x *bq, enum bq2589x_field_id id, int val)
+{
+	const struct bq2589x_field *f;
+
+	if (!bq2589x_field_writable(id))
+		return -EINVAL;
+	f = &bq2589x_fields[id];
+
+	return bq2589x_update_bits(bq, f->reg, f->mask, bq2589x_field_encode(id, val));
+}
+EXPORT_SYMBOL_GPL(bq2589x_field_write);
+
+/*
+ * Update several fields at once. Fields sharing a register cost a single
+ * write, and all of them are applied under one hold of the bus lock.
+ * Returns the number of bytes written or a negative error.
+ */
+int bq2589x_fields_write(struct bq2589x *bq, const struct bq2589x_field_val *vals, int num)
+{
+	struct bq2589x_reg_image img;
+	int i;
+
+	memset(&img, 0, sizeof(img));
+	for (i = 0; i < num; i++) {
+		if (!bq2589x_field_writable(vals[i].id))
+			return -EINVAL;
+		bq2589x_image_set_field(&img, vals[i].id, vals[i].val);
+	}
+
+	return bq2589x_apply_image(bq, &img);
+}
+EXPORT_SYMBOL_GPL(bq2589x_fields_write);
+
+static int bq2589x_enable_charger(struct bq2589x *bq)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_CHG_CONFIG, BQ25898S_CHG_ENABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_enable_charger);
+
+static int bq2589x_disable_charger(struct bq2589x *bq)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_CHG_CONFIG, BQ25898S_CHG_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_disable_charger);
+
+static int bq2589x_enable_term(struct bq2589x* bq, bool enable)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_EN_TERM,
+			enable ? BQ25898S_TERM_ENABLE : BQ25898S_TERM_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_enable_term);
 
-	ret = bq2589x_update_bits(bq, BQ25898S_REG_0D, BQ25898S_FORCE_VINDPM_MASK, val);
+
+/*
+ * Older entry points on top of the adc_users count: a continuous start takes
+ * a reference bq2589x_adc_stop() drops, so they can't switch the ADC off
+ * under the monitor or another user.
+ */
+int bq2589x_adc_start(struct bq2589x *bq, bool oneshot)
+{
+	int ret = 0;
+
+	if (!oneshot)
+		return bq2589x_adc_get(bq);
+
+	/* nothing to start while continuous conversion runs */
+	mutex_lock(&bq->adc_lock);
+	if (!bq->adc_users)
+		ret = bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_CONV_START_MASK,
+					BQ25898S_CONV_START << BQ25898S_CONV_START_SHIFT);
+	mutex_unlock(&bq->adc_lock);
 
 	return ret;
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_start);
 
+/* only after a successful bq2589x_adc_start(bq, false) */
+int bq2589x_adc_stop(struct bq2589x *bq)
+{
+	bq2589x_adc_put(bq);
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_set_absolute_vindpm);
+EXPORT_SYMBOL_GPL(bq2589x_adc_stop);
 
-static int bq2589x_read_idpm_limit(struct bq2589x *bq)
+
+int bq2589x_adc_read_battery_volt(struct bq2589x *bq)
 {
 	uint8_t val;
-	int curr;
+	int volt;
 	int ret;
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0E);
+	if (ret < 0) {
+		dev_err(bq->dev, "read battery voltage failed :%d\n", ret);
+		return ret;
+	} else{
+		volt = bq2589x_field_decode(BQ2589X_F_BATV, val);
+		return volt;
+	}
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_read_battery_volt);
 
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_13);
+
+int bq2589x_adc_read_sys_volt(struct bq2589x *bq)
+{
+	uint8_t val;
+	int volt;
+	int ret;
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0F);
 	if (ret < 0) {
-		dev_err(bq->dev, "read idpm limit failed :%d\n", ret);
+		dev_err(bq->dev, "read system voltage failed :%d\n", ret);
 		return ret;
 	} else{
-		curr = BQ25898S_IDPM_LIM_BASE + ((val & BQ25898S_IDPM_LIM_MASK) >> BQ25898S_IDPM_LIM_SHIFT) * BQ25898S_IDPM_LIM_LSB ;
-		return curr;
+		volt = bq2589x_field_decode(BQ2589X_F_SYSV, val);
+		return volt;
 	}
 }
-EXPORT_SYMBOL_GPL(bq2589x_read_idpm_limit);
+EXPORT_SYMBOL_GPL(bq2589x_adc_read_sys_volt);
 
-static bool bq2589x_is_charge_done(struct bq2589x *bq)
+int bq2589x_adc_read_vbus_volt(struct bq2589x *bq)
 {
+	uint8_t val;
+	int volt;
 	int ret;
-	u8 val;
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_11);
+	if (ret < 0) {
+		dev_err(bq->dev, "read vbus voltage failed :%d\n", ret);
+		return ret;
+	} else{
+		volt = bq2589x_field_decode(BQ2589X_F_VBUSV, val);
+		return volt;
+	}
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_read_vbus_volt);
 
-	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0B);
+int bq2589x_adc_read_charge_current(struct bq2589x *bq)
+{
+	uint8_t val;
+	int volt;
+	int ret;
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_12);
 	if (ret < 0) {
-		dev_err(bq->dev, "%s:read REG0B failed :%d\n", __func__, ret);
-		return false;
+		dev_err(bq->dev, "read charge current failed :%d\n", ret);
+		return ret;
+	} else{
+		volt = bq2589x_field_decode(BQ2589X_F_ICHGR, val);
+		return volt;
 	}
-	val &= BQ25898S_CHRG_STAT_MASK;
-	val >>= BQ25898S_CHRG_STAT_SHIFT;
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_read_charge_current);
 
-	return (val == BQ25898S_CHRG_STAT_CHGDONE);
+static int bq2589x_adc_set_continuous(struct bq2589x *bq, bool enable)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_CONV_RATE,
+			enable ? BQ25898S_ADC_CONTINUE_ENABLE : BQ25898S_ADC_CONTINUE_DISABLE);
 }
-EXPORT_SYMBOL_GPL(bq2589x_is_charge_done);
 
+/*
+ * The ADC runs in continuous mode only while somebody holds a reference,
+ * otherwise each read triggers a one-shot conversion.
+ */
+int bq2589x_adc_get(struct bq2589x *bq)
+{
+	int ret = 0;
+
+	mutex_lock(&bq->adc_lock);
+	if (bq->adc_users++ == 0) {
+		ret = bq2589x_adc_set_continuous(bq, true);
+		if (ret) {
+			dev_err(bq->dev, "%s:Failed to start ADC:%d\n", __func__, ret);
+			bq->adc_users--;
+		}
+	}
+	mutex_unlock(&bq->adc_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_get);
+
+void bq2589x_adc_put(struct bq2589x *bq)
+{
+	int ret;
 
-static int bq2589x_init_device(struct bq2589x *bq)
+	mutex_lock(&bq->adc_lock);
+	if (WARN_ON(!bq->adc_users)) {
+		mutex_unlock(&bq->adc_lock);
+		return;
+	}
+	if (--bq->adc_users == 0) {
+		ret = bq2589x_adc_set_continuous(bq, false);
+		if (ret)
+			dev_err(bq->dev, "%s:Failed to stop ADC:%d\n", __func__, ret);
+	}
+	mutex_unlock(&bq->adc_lock);
+}
+EXPORT_SYMBOL_GPL(bq2589x_adc_put);
+
+/* put CONV_RATE back in line with adc_users, e.g. after a chip reset */
+static int bq2589x_adc_sync_mode(struct bq2589x *bq)
+{
+	int ret;
+
+	mutex_lock(&bq->adc_lock);
+	ret = bq2589x_adc_set_continuous(bq, bq->adc_users > 0);
+	mutex_unlock(&bq->adc_lock);
+
+	return ret;
+}
+
+/* start a one-shot conversion and wait for the chip to clear CONV_START */
+static int bq2589x_adc_convert(struct bq2589x *bq)
 {
+	unsigned int waited = 0;
+	u8 val;
 	int ret;
 
+	ret = bq2589x_update_bits(bq, BQ25898S_REG_02, BQ25898S_CONV_START_MASK,
+				BQ25898S_CONV_START << BQ25898S_CONV_START_SHIFT);
+	if (ret)
+		return ret;
+
+	do {
+		msleep(BQ2589X_ADC_POLL_MS);
+		waited += BQ2589X_ADC_POLL_MS;
+
+		ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_02);
+		if (ret)
+			return ret;
+		if (!(val & BQ25898S_CONV_START_MASK))
+			return 0;
+	} while (waited < BQ2589X_ADC_TIMEOUT_MS);
+
+	return -ETIMEDOUT;
+}
+
+#define BQ2589X_ADC_FIRST	BQ25898S_REG_0E
+#define BQ2589X_ADC_LAST	BQ25898S_REG_13
+#define BQ2589X_ADC_NUM		(BQ2589X_ADC_LAST - BQ2589X_ADC_FIRST + 1)
+
+#define BQ2589X_ADC_FIELD(buf, id) \
+	bq2589x_field_decode(id, (buf)[bq2589x_fields[id].reg - BQ2589X_ADC_FIRST])
+
+static void bq2589x_decode_adc(const u8 *buf, struct bq2589x_adc_data *data)
+{
+	data->therm_stat = BQ2589X_ADC_FIELD(buf, BQ2589X_F_THERM_STAT);
+	data->vbat = BQ2589X_ADC_FIELD(buf, BQ2589X_F_BATV);
+	data->vsys = BQ2589X_ADC_FIELD(buf, BQ2589X_F_SYSV);
+	data->ts_pct = BQ2589X_ADC_FIELD(buf, BQ2589X_F_TSPCT);
+	data->vbus_gd = BQ2589X_ADC_FIELD(buf, BQ2589X_F_VBUS_GD);
+	data->vbus = BQ2589X_ADC_FIELD(buf, BQ2589X_F_VBUSV);
+	data->ichg = BQ2589X_ADC_FIELD(buf, BQ2589X_F_ICHGR);
+	data->vdpm = BQ2589X_ADC_FIELD(buf, BQ2589X_F_VDPM_STAT);
+	data->idpm = BQ2589X_ADC_FIELD(buf, BQ2589X_F_IDPM_STAT);
+	data->idpm_lim = BQ2589X_ADC_FIELD(buf, BQ2589X_F_IDPM_LIM);
+}
+
+static void bq2589x_publish_adc(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&bq->tlm_lock, flags);
+	bq->tlm.adc = *adc;
+	bq->tlm.timestamp = ktime_get();
+	bq->tlm.valid = true;
+	write_sequnlock_irqrestore(&bq->tlm_lock, flags);
+}
+
+#define BQ2589X_STATUS_EVENT_MASK	(BQ25898S_VBUS_STAT_MASK | BQ25898S_CHRG_STAT_MASK | \
+					BQ25898S_PG_STAT_MASK)
+
+/* returns true if the charger state visible to userspace changed */
+static bool bq2589x_publish_status(struct bq2589x *bq, u8 status, u8 fault)
+{
+	unsigned long flags;
+	bool changed;
+
+	write_seqlock_irqsave(&bq->tlm_lock, flags);
+	changed = ((bq->tlm.status ^ status) & BQ2589X_STATUS_EVENT_MASK) ||
+			bq->tlm.fault != fault;
+	bq->tlm.status = status;
+	bq->tlm.fault = fault;
+	write_sequnlock_irqrestore(&bq->tlm_lock, flags);
+
+	return changed;
+}
+
+/*
+ * Fetch all ADC results with a single block transaction, so every value
+ * comes from the same conversion cycle. Without an ADC reference a fresh
+ * one-shot conversion is run first.
+ */
+int bq2589x_read_adc(struct bq2589x *bq, struct bq2589x_adc_data *data)
+{
+	u8 buf[BQ2589X_ADC_NUM];
+	int ret = 0;
+
+	mutex_lock(&bq->adc_lock);
+	if (!bq->adc_users)
+		ret = bq2589x_adc_convert(bq);
+	if (!ret)
+		ret = bq2589x_read_block(bq, BQ2589X_ADC_FIRST, buf, BQ2589X_ADC_NUM);
+	mutex_unlock(&bq->adc_lock);
 
-	ret = bq2589x_disable_watchdog_timer(bq);
 	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to disable watchdog timer:%d\n", __func__, ret);
+		dev_err(bq->dev, "%s:read adc registers failed:%d\n", __func__, ret);
 		return ret;
 	}
 
-	ret = bq2589x_enable_auto_dpdm(bq, false);//always disable autodpdm when acting as slave
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to disable auto dpdm:%d\n", __func__, ret);
-		return ret;
-	}
+	bq2589x_decode_adc(buf, data);
+	bq2589x_publish_adc(bq, data);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_read_adc);
+
+/**
+ * bq2589x_get_telemetry - copy out the last published telemetry
+ * @bq: slave charger instance
+ * @tlm: filled with the snapshot; tlm->valid is false until the first read
+ *
+ * Never sleeps and never touches the bus.
+ */
+void bq2589x_get_telemetry(struct bq2589x *bq, struct bq2589x_telemetry *tlm)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&bq->tlm_lock);
+		*tlm = bq->tlm;
+	} while (read_seqretry(&bq->tlm_lock, seq));
+}
+EXPORT_SYMBOL_GPL(bq2589x_get_telemetry);
+
+/**
+ * bq2589x_get_telemetry_fresh - telemetry no older than @max_age_ms
+ * @bq: slave charger instance
+ * @tlm: filled with the snapshot
+ * @max_age_ms: accepted age of the ADC values
+ *
+ * Only reads the chip when the published snapshot is too old, may sleep.
+ */
+int bq2589x_get_telemetry_fresh(struct bq2589x *bq, struct bq2589x_telemetry *tlm,
+				unsigned int max_age_ms)
+{
+	struct bq2589x_adc_data adc;
+	int ret;
+
+	bq2589x_get_telemetry(bq, tlm);
+	if (tlm->valid && ktime_ms_delta(ktime_get(), tlm->timestamp) <= max_age_ms)
+		return 0;
+
+	ret = bq2589x_read_adc(bq, &adc);
+	if (ret)
+		return ret;
+
+	bq2589x_get_telemetry(bq, tlm);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_get_telemetry_fresh);
+
+int bq2589x_set_chargecurrent(struct bq2589x *bq, int curr)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_ICHG, curr);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_chargecurrent);
+
+int bq2589x_set_term_current(struct bq2589x *bq, int curr)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_ITERM, curr);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_term_current);
+
+
+int bq2589x_set_prechg_current(struct bq2589x *bq, int curr)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_IPRECHG, curr);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_prechg_current);
+
+int bq2589x_set_chargevoltage(struct bq2589x *bq, int volt)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_VREG, volt);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_chargevoltage);
+
+
+int bq2589x_set_input_volt_limit(struct bq2589x *bq, int volt)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_VINDPM, volt);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_input_volt_limit);
+
+int bq2589x_set_input_current_limit(struct bq2589x *bq, int curr)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_IINLIM, curr);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_input_current_limit);
+
+
+int bq2589x_set_vindpm_offset(struct bq2589x *bq, int offset)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_VINDPM_OS,
+			offset == 400 ? BQ25898S_VINDPMOS_400MV : BQ25898S_VINDPMOS_600MV);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_vindpm_offset);
+
+int bq2589x_get_charging_status(struct bq2589x *bq)
+{
+	u8 val = 0;
+	int ret;
+
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0B);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s Failed to read register 0x0b:%d\n", __func__, ret);
+		return ret;
+	}
+	val &= BQ25898S_CHRG_STAT_MASK;
+	val >>= BQ25898S_CHRG_STAT_SHIFT;
+	return val;
+}
+EXPORT_SYMBOL_GPL(bq2589x_get_charging_status);
+
+/* the watchdog only supports 40s, 80s and 160s, round up to the next one */
+int bq2589x_set_watchdog_timer(struct bq2589x *bq, u8 timeout)
+{
+	int val;
+
+	if (!timeout)
+		val = BQ25898S_WDT_DISABLE;
+	else if (timeout <= 40)
+		val = BQ25898S_WDT_40S;
+	else if (timeout <= 80)
+		val = BQ25898S_WDT_80S;
+	else
+		val = BQ25898S_WDT_160S;
+
+	return bq2589x_field_write(bq, BQ2589X_F_WDT, val);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_watchdog_timer);
+
+int bq2589x_disable_watchdog_timer(struct bq2589x *bq)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_WDT, BQ25898S_WDT_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_disable_watchdog_timer);
+
+int bq2589x_reset_watchdog_timer(struct bq2589x *bq)
+{
+	u8 val = BQ25898S_WDT_RESET << BQ25898S_WDT_RESET_SHIFT;
+
+	return bq2589x_update_bits(bq, BQ25898S_REG_03, BQ25898S_WDT_RESET_MASK, val);
+}
+EXPORT_SYMBOL_GPL(bq2589x_reset_watchdog_timer);
+
+int bq2589x_reset_chip(struct bq2589x *bq)
+{
+	int ret;
+	u8 val = BQ25898S_RESET << BQ25898S_RESET_SHIFT;
+
+	ret = bq2589x_update_bits(bq, BQ25898S_REG_14, BQ25898S_RESET_MASK, val);
+	bq2589x_cache_invalidate(bq);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(bq2589x_reset_chip);
+
+int bq2589x_enter_hiz_mode(struct bq2589x *bq)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_EN_HIZ, BQ25898S_HIZ_ENABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_enter_hiz_mode);
+
+int bq2589x_exit_hiz_mode(struct bq2589x *bq)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_EN_HIZ, BQ25898S_HIZ_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_exit_hiz_mode);
+
+int bq2589x_get_hiz_mode(struct bq2589x *bq, u8 *state)
+{
+	int val;
+	int ret;
+
+	ret = bq2589x_field_read(bq, BQ2589X_F_EN_HIZ, &val);
+	if (ret)
+		return ret;
+	*state = val;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_get_hiz_mode);
+
+
+static int bq2589x_enable_auto_dpdm(struct bq2589x* bq, bool enable)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_AUTO_DPDM_EN,
+			enable ? BQ25898S_AUTO_DPDM_ENABLE : BQ25898S_AUTO_DPDM_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_enable_auto_dpdm);
+
+static int bq2589x_set_absolute_vindpm(struct bq2589x* bq, bool enable)
+{
+	return bq2589x_field_write(bq, BQ2589X_F_FORCE_VINDPM,
+			enable ? BQ25898S_FORCE_VINDPM_ENABLE : BQ25898S_FORCE_VINDPM_DISABLE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_set_absolute_vindpm);
+
+static int bq2589x_read_idpm_limit(struct bq2589x *bq)
+{
+	uint8_t val;
+	int curr;
+	int ret;
+
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_13);
+	if (ret < 0) {
+		dev_err(bq->dev, "read idpm limit failed :%d\n", ret);
+		return ret;
+	} else{
+		curr = bq2589x_field_decode(BQ2589X_F_IDPM_LIM, val);
+		return curr;
+	}
+}
+EXPORT_SYMBOL_GPL(bq2589x_read_idpm_limit);
+
+static bool bq2589x_is_charge_done(struct bq2589x *bq)
+{
+	int ret;
+	u8 val;
+
+	ret = bq2589x_read_byte(bq, &val, BQ25898S_REG_0B);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:read REG0B failed :%d\n", __func__, ret);
+		return false;
+	}
+	val &= BQ25898S_CHRG_STAT_MASK;
+	val >>= BQ25898S_CHRG_STAT_SHIFT;
+
+	return (val == BQ25898S_CHRG_STAT_CHGDONE);
+}
+EXPORT_SYMBOL_GPL(bq2589x_is_charge_done);
+
+
+static int bq2589x_init_device(struct bq2589x *bq)
+{
+	struct bq2589x_field_val init[] = {
+		{ BQ2589X_F_WDT,		BQ25898S_WDT_DISABLE },
+		/* always disable autodpdm when acting as slave */
+		{ BQ2589X_F_AUTO_DPDM_EN,	BQ25898S_AUTO_DPDM_DISABLE },
+		{ BQ2589X_F_EN_TERM,		bq->cfg.enable_term },
+		/* use absolute mode vindpm setting */
+		{ BQ2589X_F_FORCE_VINDPM,	BQ25898S_FORCE_VINDPM_ENABLE },
+		{ BQ2589X_F_CHG_CONFIG,		BQ25898S_CHG_DISABLE },
+	};
+	int ret;
+
+	ret = bq2589x_fields_write(bq, init, ARRAY_SIZE(init));
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:Failed to apply initial settings:%d\n", __func__, ret);
+		return ret;
+	}
+
+	ret = bq2589x_adc_sync_mode(bq);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:Failed to set ADC mode:%d\n", __func__, ret);
+	}
+
+	return ret;
+}
+
+
+/* called from anywhere, the state machine picks the events up in order */
+static void bq2589x_post_event(struct bq2589x *bq, unsigned long event)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bq->req_lock, flags);
+	if (!bq->stopping) {
+		bq->events |= event;
+		queue_work(bq->wq, &bq->event_work);
+	}
+	spin_unlock_irqrestore(&bq->req_lock, flags);
+}
+
+/* hand STATUS and latched FAULT bits to the state machine */
+static void bq2589x_post_status(struct bq2589x *bq, u8 status, u8 fault)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bq->req_lock, flags);
+	bq->irq_status = status;
+	bq->irq_fault |= fault;
+	spin_unlock_irqrestore(&bq->req_lock, flags);
+
+	bq2589x_post_event(bq, BQ2589X_EVT_IRQ);
+}
+
+/*
+ * Reading REG_0C clears the faults latched in it. A dump covering it must
+ * not swallow them, e.g. a watchdog expiry the state machine has to undo.
+ */
+static void bq2589x_dump_faults(struct bq2589x *bq, const u8 *regs, u8 first, u8 len)
+{
+	struct bq2589x_telemetry tlm;
+	u8 status;
+	u8 fault;
+
+	if (first > BQ25898S_REG_0C || first + len <= BQ25898S_REG_0C)
+		return;
+
+	fault = regs[BQ25898S_REG_0C - first];
+	if (!fault)
+		return;
+
+	if (first <= BQ25898S_REG_0B) {
+		status = regs[BQ25898S_REG_0B - first];
+	} else {
+		bq2589x_get_telemetry(bq, &tlm);
+		status = tlm.status;
+	}
+
+	if (fault & BQ25898S_FAULT_WDT_MASK) {
+		/* control registers are back to their defaults */
+		bq2589x_cache_invalidate(bq);
+	}
+
+	bq2589x_post_status(bq, status, fault);
+}
+
+static ssize_t bq2589x_show_registers(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bq2589x *bq = dev_get_drvdata(dev);
+	u8 regs[BQ25898S_REG_NUM];
+	ktime_t start;
+	u8 addr;
+	int idx;
+	int ret;
+
+	/* one block read, so the whole dump is a single consistent snapshot */
+	start = bq2589x_op_begin(bq, BQ2589X_OP_DUMP);
+	ret = bq2589x_read_block(bq, 0, regs, BQ25898S_REG_NUM);
+	bq2589x_op_end(bq, BQ2589X_OP_DUMP, start);
+	if (ret)
+		return ret;
+	bq2589x_dump_faults(bq, regs, 0, BQ25898S_REG_NUM);
+
+	idx = scnprintf(buf, PAGE_SIZE, "%s:\n", "Charger");
+	for (addr = 0; addr < BQ25898S_REG_NUM; addr++)
+		idx += scnprintf(buf + idx, PAGE_SIZE - idx, "Reg[0x%.2x] = 0x%.2x\n", addr, regs[addr]);
+
+	return idx;
+}
+
+/* raw register image 0x00-0x14, the file offset is the register address */
+static ssize_t bq2589x_read_registers_raw(struct file *filp, struct kobject *kobj,
+				struct bin_attribute *attr, char *buf,
+				loff_t off, size_t count)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct bq2589x *bq = dev_get_drvdata(dev);
+	ktime_t start;
+	int ret;
+
+	if (off >= BQ25898S_REG_NUM)
+		return 0;
+
+	count = min_t(size_t, count, BQ25898S_REG_NUM - off);
+	start = bq2589x_op_begin(bq, BQ2589X_OP_DUMP);
+	ret = bq2589x_read_block(bq, off, buf, count);
+	bq2589x_op_end(bq, BQ2589X_OP_DUMP, start);
+	if (ret)
+		return ret;
+	bq2589x_dump_faults(bq, buf, off, count);
+
+	return count;
+}
+
+
+static ssize_t bq2589x_show_adc(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bq2589x *bq = dev_get_drvdata(dev);
+	struct bq2589x_telemetry tlm;
+	struct bq2589x_adc_data *adc = &tlm.adc;
+	int ret;
+
+	ret = bq2589x_get_telemetry_fresh(bq, &tlm, 1000);
+	if (ret)
+		return ret;
+
+	return scnprintf(buf, PAGE_SIZE,
+			"vbus:%d\nvbat:%d\nvsys:%d\nichg:%d\nts_pct:%d\n"
+			"idpm_lim:%d\nvbus_gd:%d\nvdpm:%d\nidpm:%d\ntherm_stat:%d\n",
+			adc->vbus, adc->vbat, adc->vsys, adc->ichg, adc->ts_pct,
+			adc->idpm_lim, adc->vbus_gd, adc->vdpm, adc->idpm, adc->therm_stat);
+}
+
+static ssize_t bq2589x_show_irq_latency(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct bq2589x *bq = dev_get_drvdata(dev);
+	s64 avg = 0;
+
+	if (bq->irq_count)
+		avg = div_s64(bq->irq_latency_total, bq->irq_count);
+
+	return scnprintf(buf, PAGE_SIZE, "count:%u\nlast_us:%lld\nmax_us:%lld\navg_us:%lld\n",
+			bq->irq_count, bq->irq_latency_last, bq->irq_latency_max, avg);
+}
+
+static DEVICE_ATTR(registers, S_IRUGO, bq2589x_show_registers, NULL);
+static DEVICE_ATTR(adc, S_IRUGO, bq2589x_show_adc, NULL);
+static DEVICE_ATTR(irq_latency, S_IRUGO, bq2589x_show_irq_latency, NULL);
+
+static struct attribute *bq2589x_attributes[] = {
+	&dev_attr_registers.attr,
+	&dev_attr_adc.attr,
+	&dev_attr_irq_latency.attr,
+	NULL,
+};
+
+static struct bin_attribute bq2589x_registers_raw_attr = {
+	.attr = {
+		.name = "registers_raw",
+		.mode = S_IRUGO,
+	},
+	.size = BQ25898S_REG_NUM,
+	.read = bq2589x_read_registers_raw,
+};
+
+static struct bin_attribute *bq2589x_bin_attributes[] = {
+	&bq2589x_registers_raw_attr,
+	NULL,
+};
+
+static const struct attribute_group bq2589x_attr_group = {
+	.attrs = bq2589x_attributes,
+	.bin_attrs = bq2589x_bin_attributes,
+};
+
+
+static enum power_supply_property bq2589x_psy_props[] = {
+	POWER_SUPPLY_PROP_STATUS,
+	POWER_SUPPLY_PROP_CHARGE_TYPE,
+	POWER_SUPPLY_PROP_ONLINE,
+	POWER_SUPPLY_PROP_HEALTH,
+	POWER_SUPPLY_PROP_VOLTAGE_NOW,
+	POWER_SUPPLY_PROP_CURRENT_NOW,
+	POWER_SUPPLY_PROP_CURRENT_MAX,
+	POWER_SUPPLY_PROP_CONSTANT_CHARGE_CURRENT,
+	POWER_SUPPLY_PROP_CONSTANT_CHARGE_VOLTAGE,
+};
+
+/*
+ * Peek at the register cache without taking the bus lock; a single byte is
+ * read atomically and a stale value is good enough for reporting.
+ */
+static int bq2589x_peek_field(struct bq2589x *bq, enum bq2589x_field_id id, int *val)
+{
+	u8 reg = bq2589x_fields[id].reg;
+
+	if (!(READ_ONCE(bq->regs_valid) & BIT(reg)))
+		return -ENODATA;
+
+	*val = bq2589x_field_decode(id, READ_ONCE(bq->regs[reg]));
+	return 0;
+}
+
+static int bq2589x_psy_health(u8 fault)
+{
+	if (fault & BQ25898S_FAULT_WDT_MASK)
+		return POWER_SUPPLY_HEALTH_WATCHDOG_TIMER_EXPIRE;
+	if (fault & BQ25898S_FAULT_BAT_MASK)
+		return POWER_SUPPLY_HEALTH_OVERVOLTAGE;
+
+	switch ((fault & BQ25898S_FAULT_CHRG_MASK) >> BQ25898S_FAULT_CHRG_SHIFT) {
+	case BQ25898S_FAULT_CHRG_INPUT:
+		return POWER_SUPPLY_HEALTH_OVERVOLTAGE;
+	case BQ25898S_FAULT_CHRG_THERMAL:
+		return POWER_SUPPLY_HEALTH_OVERHEAT;
+	case BQ25898S_FAULT_CHRG_TIMER:
+		return POWER_SUPPLY_HEALTH_SAFETY_TIMER_EXPIRE;
+	default:
+		return POWER_SUPPLY_HEALTH_GOOD;
+	}
+}
+
+/* served from the telemetry snapshot and the register cache, no bus I/O */
+static int bq2589x_psy_get_property(struct power_supply *psy,
+				enum power_supply_property psp,
+				union power_supply_propval *val)
+{
+	struct bq2589x *bq = container_of(psy, struct bq2589x, psy);
+	struct bq2589x_telemetry tlm;
+	u8 chrg_stat;
+	int ret;
+
+	bq2589x_get_telemetry(bq, &tlm);
+	chrg_stat = (tlm.status & BQ25898S_CHRG_STAT_MASK) >> BQ25898S_CHRG_STAT_SHIFT;
+
+	switch (psp) {
+	case POWER_SUPPLY_PROP_STATUS:
+		if (READ_ONCE(bq->state) == BQ2589X_STATE_ABSENT)
+			val->intval = POWER_SUPPLY_STATUS_DISCHARGING;
+		else if (chrg_stat == BQ25898S_CHRG_STAT_CHGDONE)
+			val->intval = POWER_SUPPLY_STATUS_FULL;
+		else if (chrg_stat == BQ25898S_CHRG_STAT_IDLE)
+			val->intval = POWER_SUPPLY_STATUS_NOT_CHARGING;
+		else
+			val->intval = POWER_SUPPLY_STATUS_CHARGING;
+		break;
+	case POWER_SUPPLY_PROP_CHARGE_TYPE:
+		if (chrg_stat == BQ25898S_CHRG_STAT_PRECHG)
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_TRICKLE;
+		else if (chrg_stat == BQ25898S_CHRG_STAT_FASTCHG)
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_FAST;
+		else
+			val->intval = POWER_SUPPLY_CHARGE_TYPE_NONE;
+		break;
+	case POWER_SUPPLY_PROP_ONLINE:
+		val->intval = READ_ONCE(bq->state) != BQ2589X_STATE_ABSENT;
+		break;
+	case POWER_SUPPLY_PROP_HEALTH:
+		val->intval = bq2589x_psy_health(tlm.fault);
+		break;
+	case POWER_SUPPLY_PROP_VOLTAGE_NOW:
+		if (!tlm.valid)
+			return -ENODATA;
+		val->intval = tlm.adc.vbus * 1000;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_NOW:
+		if (!tlm.valid)
+			return -ENODATA;
+		val->intval = tlm.adc.ichg * 1000;
+		break;
+	case POWER_SUPPLY_PROP_CURRENT_MAX:
+		ret = bq2589x_peek_field(bq, BQ2589X_F_IINLIM, &val->intval);
+		if (ret)
+			return ret;
+		val->intval *= 1000;
+		break;
+	case POWER_SUPPLY_PROP_CONSTANT_CHARGE_CURRENT:
+		ret = bq2589x_peek_field(bq, BQ2589X_F_ICHG, &val->intval);
+		if (ret)
+			return ret;
+		val->intval *= 1000;
+		break;
+	case POWER_SUPPLY_PROP_CONSTANT_CHARGE_VOLTAGE:
+		ret = bq2589x_peek_field(bq, BQ2589X_F_VREG, &val->intval);
+		if (ret)
+			return ret;
+		val->intval *= 1000;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int bq2589x_psy_register(struct bq2589x *bq)
+{
+	bq->psy.name = devm_kasprintf(bq->dev, GFP_KERNEL, "bq25898s-%s", dev_name(bq->dev));
+	if (!bq->psy.name)
+		return -ENOMEM;
+
+	bq->psy.type = POWER_SUPPLY_TYPE_USB;
+	bq->psy.properties = bq2589x_psy_props;
+	bq->psy.num_properties = ARRAY_SIZE(bq2589x_psy_props);
+	bq->psy.get_property = bq2589x_psy_get_property;
+
+	return power_supply_register(bq->dev, &bq->psy);
+}
+
+/* compile the DT charge settings into the register image applied at plug-in */
+static void bq2589x_build_profile(struct bq2589x *bq)
+{
+	struct bq2589x_reg_image *img = &bq->profile;
+
+	memset(img, 0, sizeof(*img));
+	bq2589x_image_set_field(img, BQ2589X_F_VREG, bq->cfg.charge_voltage);
+	bq2589x_image_set_field(img, BQ2589X_F_ITERM, bq->cfg.term_current);
+}
+
+/* <vbat-mV ichg-mA> pairs with ascending vbat, from DT or platform data */
+static void bq2589x_set_step_charge(struct bq2589x *bq, const u32 *table, int num)
+{
+	int i;
+
+	if (num <= 0 || num > BQ2589X_STEP_MAX) {
+		dev_err(bq->dev, "%s:invalid step-charge table\n", __func__);
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		if (i && table[i * 2] <= table[i * 2 - 2]) {
+			dev_err(bq->dev, "%s:step-charge vbat not ascending\n", __func__);
+			return;
+		}
+		bq->cfg.step[i].vbat = table[i * 2];
+		bq->cfg.step[i].ichg = table[i * 2 + 1];
+	}
+	bq->cfg.step_num = num;
+}
+
+/* optional ti,bq2589x,step-charge */
+static void bq2589x_parse_step_charge(struct bq2589x *bq, struct device_node *np)
+{
+	u32 table[BQ2589X_STEP_MAX * 2];
+	int len;
+	int num;
+	int ret;
+
+	if (!of_find_property(np, "ti,bq2589x,step-charge", &len))
+		return;
+
+	num = len / (2 * sizeof(u32));
+	if (!num || num > BQ2589X_STEP_MAX || len % (2 * sizeof(u32))) {
+		dev_err(bq->dev, "%s:invalid step-charge table\n", __func__);
+		return;
+	}
+
+	ret = of_property_read_u32_array(np, "ti,bq2589x,step-charge", table, num * 2);
+	if (ret) {
+		dev_err(bq->dev, "%s:Failed to read step-charge table:%d\n", __func__, ret);
+		return;
+	}
+
+	bq2589x_set_step_charge(bq, table, num);
+}
+
+/* used without a thermal-mitigation table, in percent of the configured limits */
+static const int bq2589x_thermal_pct[] = { 100, 75, 50, 25, 0 };
+
+/*
+ * Precompute the limits of each cooling state, so a state change is just
+ * a lookup. State 0 normally leaves everything to the other settings.
+ * @table holds <ichg-mA iinlim-mA> pairs; an invalid one leaves the
+ * levels to bq2589x_default_thermal().
+ */
+static void bq2589x_set_thermal(struct bq2589x *bq, const u32 *table, int num)
+{
+	int i;
+
+	if (num <= 0 || num > BQ2589X_THERMAL_MAX) {
+		dev_err(bq->dev, "%s:invalid thermal-mitigation table, using default\n", __func__);
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		bq->cfg.thermal[i].ichg = table[i * 2];
+		bq->cfg.thermal[i].iinlim = table[i * 2 + 1];
+	}
+	bq->cfg.thermal_levels = num;
+}
+
+static void bq2589x_default_thermal(struct bq2589x *bq)
+{
+	struct bq2589x_config *cfg = &bq->cfg;
+	int ichg = cfg->charge_current;
+	int i;
+
+	for (i = 0; i < cfg->step_num; i++)
+		ichg = max(ichg, cfg->step[i].ichg);
+
+	for (i = 0; i < ARRAY_SIZE(bq2589x_thermal_pct); i++) {
+		if (bq2589x_thermal_pct[i] == 100) {
+			cfg->thermal[i].ichg = -1;
+			cfg->thermal[i].iinlim = -1;
+		} else {
+			cfg->thermal[i].ichg = ichg * bq2589x_thermal_pct[i] / 100;
+			cfg->thermal[i].iinlim = cfg->iindpm_threshold * bq2589x_thermal_pct[i] / 100;
+		}
+	}
+	cfg->thermal_levels = ARRAY_SIZE(bq2589x_thermal_pct);
+}
+
+/* optional ti,bq2589x,thermal-mitigation */
+static void bq2589x_parse_thermal(struct bq2589x *bq, struct device_node *np)
+{
+	u32 table[BQ2589X_THERMAL_MAX * 2];
+	int len;
+	int num;
+
+	if (!of_find_property(np, "ti,bq2589x,thermal-mitigation", &len))
+		return;
+
+	num = len / (2 * sizeof(u32));
+	if (len % (2 * sizeof(u32)) || num > BQ2589X_THERMAL_MAX ||
+	    of_property_read_u32_array(np, "ti,bq2589x,thermal-mitigation", table, num * 2))
+		num = 0;
+
+	bq2589x_set_thermal(bq, table, num);
+}
+
+/*
+ * <ts-min ts-max vreg-mV ichg-mA> zones, TS in 0.001% of REGN. Each zone's
+ * VREG/ICHG image is built here, switching zones only has to apply it.
+ */
+static void bq2589x_set_jeita(struct bq2589x *bq, const u32 *table, int num)
+{
+	struct bq2589x_jeita_zone *z;
+	int i;
+
+	if (num <= 0 || num > BQ2589X_JEITA_MAX) {
+		dev_err(bq->dev, "%s:invalid jeita-zones table\n", __func__);
+		return;
+	}
+
+	for (i = 0; i < num; i++) {
+		z = &bq->cfg.jeita[i];
+		z->ts_min = table[i * 4];
+		z->ts_max = table[i * 4 + 1];
+		z->vreg = min_t(int, table[i * 4 + 2], bq->cfg.charge_voltage);
+		z->ichg = table[i * 4 + 3];
+		if (z->ts_min >= z->ts_max) {
+			dev_err(bq->dev, "%s:empty jeita zone %d\n", __func__, i);
+			return;
+		}
+
+		memset(&z->img, 0, sizeof(z->img));
+		bq2589x_image_set_field(&z->img, BQ2589X_F_VREG, z->vreg);
+		bq2589x_image_set_field(&z->img, BQ2589X_F_ICHG, z->ichg);
+	}
+	bq->cfg.jeita_num = num;
+}
+
+/* optional ti,bq2589x,jeita-zones */
+static void bq2589x_parse_jeita(struct bq2589x *bq, struct device_node *np)
+{
+	u32 table[BQ2589X_JEITA_MAX * 4];
+	int len;
+	int num;
+	int ret;
+
+	if (!of_find_property(np, "ti,bq2589x,jeita-zones", &len))
+		return;
+
+	num = len / (4 * sizeof(u32));
+	if (!num || num > BQ2589X_JEITA_MAX || len % (4 * sizeof(u32))) {
+		dev_err(bq->dev, "%s:invalid jeita-zones table\n", __func__);
+		return;
+	}
+
+	ret = of_property_read_u32_array(np, "ti,bq2589x,jeita-zones", table, num * 4);
+	if (ret) {
+		dev_err(bq->dev, "%s:Failed to read jeita-zones table:%d\n", __func__, ret);
+		return;
+	}
+
+	bq2589x_set_jeita(bq, table, num);
+}
+
+/*
+ * The chip's own power-on settings, kept for whatever neither the DT nor
+ * the platform data gives, so a bare probe charges like an unmanaged chip
+ * instead of at 0mA.
+ */
+static void bq2589x_default_config(struct bq2589x *bq)
+{
+	bq->cfg.charge_voltage = 4208;
+	bq->cfg.charge_current = 2048;
+	bq->cfg.term_current = 256;
+	bq->cfg.iindpm_threshold = 500;
+	bq->cfg.vindpm_threshold = 4400;
+	bq->cfg.share_pct = 50;
+}
+
+/* required by the binding, the default stays if it is missing anyway */
+static void bq2589x_parse_dt_u32(struct bq2589x *bq, struct device_node *np,
+				const char *prop, int *val)
+{
+	u32 v;
+
+	if (of_property_read_u32(np, prop, &v)) {
+		dev_err(bq->dev, "%s:no %s, using %d\n", __func__, prop, *val);
+		return;
+	}
+	*val = v;
+}
+
+static void bq2589x_parse_dt(struct device *dev, struct bq2589x *bq)
+{
+	struct device_node *np = dev->of_node;
+
+	bq->cfg.enable_auto_dpdm = of_property_read_bool(np, "ti,bq2589x,enable-auto-dpdm");
+	bq->cfg.enable_term = of_property_read_bool(np, "ti,bq2589x,enable-termination");
+	bq->cfg.use_absolute_vindpm = of_property_read_bool(np, "ti,bq2589x,use-absolute-vindpm");
+
+	bq2589x_parse_dt_u32(bq, np, "ti,bq2589x,charge-voltage", &bq->cfg.charge_voltage);
+	bq2589x_parse_dt_u32(bq, np, "ti,bq2589x,charge-current", &bq->cfg.charge_current);
+	bq2589x_parse_dt_u32(bq, np, "ti,bq2589x,term-current", &bq->cfg.term_current);
+	bq2589x_parse_dt_u32(bq, np, "ti,bq2589x,input-current-limit", &bq->cfg.iindpm_threshold);
+	bq2589x_parse_dt_u32(bq, np, "ti,bq2589x,input-voltage-limit", &bq->cfg.vindpm_threshold);
+
+	of_property_read_u32(np, "ti,bq2589x,current-share", &bq->cfg.share_pct);
+	/* optional, enables the adaptive input current limit */
+	of_property_read_u32(np, "ti,bq2589x,aicl-max-current", &bq->cfg.aicl_max_current);
+
+	bq2589x_parse_step_charge(bq, np);
+	bq2589x_parse_thermal(bq, np);
+	bq2589x_parse_jeita(bq, np);
+}
+
+/* the same settings from a board file or the chip model, 0 keeps a default */
+static void bq2589x_parse_pdata(struct bq2589x *bq, const struct bq2589x_platform_data *pdata)
+{
+	struct bq2589x_config *cfg = &bq->cfg;
+
+	cfg->enable_auto_dpdm = pdata->enable_auto_dpdm;
+	cfg->enable_term = pdata->enable_term;
+	cfg->use_absolute_vindpm = pdata->use_absolute_vindpm;
+
+	if (pdata->charge_voltage)
+		cfg->charge_voltage = pdata->charge_voltage;
+	if (pdata->charge_current)
+		cfg->charge_current = pdata->charge_current;
+	if (pdata->term_current)
+		cfg->term_current = pdata->term_current;
+	if (pdata->input_current_limit)
+		cfg->iindpm_threshold = pdata->input_current_limit;
+	if (pdata->input_voltage_limit)
+		cfg->vindpm_threshold = pdata->input_voltage_limit;
+	if (pdata->current_share)
+		cfg->share_pct = pdata->current_share;
+	cfg->aicl_max_current = pdata->aicl_max_current;
+
+	if (pdata->step_num)
+		bq2589x_set_step_charge(bq, pdata->step_charge, pdata->step_num);
+	if (pdata->thermal_num)
+		bq2589x_set_thermal(bq, pdata->thermal_mitigation, pdata->thermal_num);
+	if (pdata->jeita_num)
+		bq2589x_set_jeita(bq, pdata->jeita_zones, pdata->jeita_num);
+}
+
+/* votes and images that follow from the configuration, whatever its source */
+static void bq2589x_apply_config(struct bq2589x *bq)
+{
+	if (bq->cfg.share_pct < 1 || bq->cfg.share_pct > 100) {
+		dev_err(bq->dev, "%s:invalid current-share %d, using 50\n",
+				__func__, bq->cfg.share_pct);
+		bq->cfg.share_pct = 50;
+	}
+
+	if (!bq->cfg.thermal_levels)
+		bq2589x_default_thermal(bq);
+
+	if (!bq->cfg.step_num)
+		bq->ichg_votes[BQ2589X_ICHG_VOTE_DT] = bq->cfg.charge_current;
+	bq->ichg_votes[BQ2589X_ICHG_VOTE_THERMAL] = bq->cfg.thermal[0].ichg;
+	bq->thermal_iinlim = bq->cfg.thermal[0].iinlim;
+
+	bq2589x_build_profile(bq);
+}
+
+static int bq2589x_detect_device(struct bq2589x *bq)
+{
+	int ret;
+	u8 data;
+
+	ret = bq2589x_read_byte(bq, &data, BQ25898S_REG_14);
+	if (ret == 0) {
+		bq->part_no = (data & BQ25898S_PN_MASK) >> BQ25898S_PN_SHIFT;
+		bq->revision = (data & BQ25898S_DEV_REV_MASK) >> BQ25898S_DEV_REV_SHIFT;
+	}
+
+	return ret;
+}
+
+/* refresh the cached capacity from the "battery" supply */
+static int bq2589x_update_rsoc(struct bq2589x *bq)
+{
+	union power_supply_propval val = {0,};
+	int ret;
+
+	if (!bq->batt_psy)
+		bq->batt_psy = power_supply_get_by_name("battery");
+	if (!bq->batt_psy)
+		return -ENODEV;
+
+	ret = bq->batt_psy->get_property(bq->batt_psy, POWER_SUPPLY_PROP_CAPACITY, &val);
+	if (ret)
+		return ret;
+
+	bq->rsoc = val.intval;
+	return 0;
+}
+
+static bool bq2589x_battery_full(struct bq2589x *bq)
+{
+	return bq->rsoc > BQ2589X_RSOC_FULL;
+}
+
+
+/* absolute VINDPM for @vbus_volt, never below the DT input-voltage-limit */
+static int bq2589x_vindpm_for_vbus(struct bq2589x *bq, int vbus_volt)
+{
+	int vindpm;
+
+	if (vbus_volt < 6000)
+		vindpm = vbus_volt - 600;
+	else
+		vindpm = vbus_volt - 1200;
+
+	return max(vindpm, bq->cfg.vindpm_threshold);
+}
+
+static int bq2589x_ichg_effective(struct bq2589x *bq)
+{
+	int ichg = INT_MAX;
+	int i;
+
+	for (i = 0; i < BQ2589X_ICHG_VOTERS; i++) {
+		if (bq->ichg_votes[i] >= 0)
+			ichg = min(ichg, bq->ichg_votes[i]);
+	}
+
+	return ichg == INT_MAX ? 0 : ichg;
+}
+
+/* what AICL settled on, or the DT limit, unless cooling asks for less */
+static int bq2589x_iinlim_effective(struct bq2589x *bq)
+{
+	int iinlim = bq->aicl_limit;
+
+	if (bq->thermal_iinlim >= 0)
+		iinlim = min(iinlim, bq->thermal_iinlim);
+
+	return iinlim;
+}
+
+/* called from the state machine only */
+static int bq2589x_update_iinlim(struct bq2589x *bq)
+{
+	int iinlim = bq2589x_iinlim_effective(bq);
+	int ret;
+
+	if (iinlim == bq->iinlim)
+		return 0;
+
+	ret = bq2589x_field_write(bq, BQ2589X_F_IINLIM, iinlim);
+	if (ret) {
+		dev_err(bq->dev, "%s:Failed to set input current limit:%d\n", __func__, ret);
+		return ret;
+	}
+
+	bq->iinlim = iinlim;
+	return 0;
+}
+
+/* called from the state machine only */
+static int bq2589x_vote_ichg(struct bq2589x *bq, enum bq2589x_ichg_voter voter, int curr)
+{
+	int ichg;
+	int ret;
+
+	bq->ichg_votes[voter] = curr;
+	ichg = bq2589x_ichg_effective(bq);
+	if (ichg == bq->ichg)
+		return 0;
+
+	ret = bq2589x_field_write(bq, BQ2589X_F_ICHG, ichg);
+	if (ret) {
+		dev_err(bq->dev, "%s:Failed to set charge current:%d\n", __func__, ret);
+		return ret;
+	}
+
+	dev_dbg(bq->dev, "%s:charge current %d -> %d mA\n", __func__, bq->ichg, ichg);
+	bq->ichg = ichg;
+	return 0;
+}
+
+/*
+ * Apply the prebuilt profile plus an absolute VINDPM derived from @vbus_volt
+ * and the current charge and input current limits.
+ * Returns the number of bytes written or a negative error.
+ */
+static int __bq2589x_set_charge_profile(struct bq2589x *bq, int vbus_volt)
+{
+	struct bq2589x_reg_image img = bq->profile;
+	int vindpm_volt;
+	int ichg;
+	int iinlim;
+	int ret;
+
+	vindpm_volt = bq2589x_vindpm_for_vbus(bq, vbus_volt);
+	bq2589x_image_set_field(&img, BQ2589X_F_VINDPM, vindpm_volt);
+	ichg = bq2589x_ichg_effective(bq);
+	bq2589x_image_set_field(&img, BQ2589X_F_ICHG, ichg);
+	iinlim = bq2589x_iinlim_effective(bq);
+	bq2589x_image_set_field(&img, BQ2589X_F_IINLIM, iinlim);
+	if (bq->jeita_vreg >= 0)
+		bq2589x_image_set_field(&img, BQ2589X_F_VREG, bq->jeita_vreg);
+
+	ret = bq2589x_apply_image(bq, &img);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:Failed to apply charge profile:%d\n", __func__, ret);
+		return ret;
+	}
+	bq->vindpm = vindpm_volt;
+	bq->ichg = ichg;
+	bq->iinlim = iinlim;
+
+	dev_info(bq->dev, "%s:charge profile applied, vindpm %d, %d bytes written\n",
+			__func__, vindpm_volt, ret);
+	return ret;
+}
+
+int bq2589x_set_charge_profile(struct bq2589x *bq)
+{
+	struct bq2589x_adc_data adc;
+	int ret;
+
+	ret = bq2589x_read_adc(bq, &adc);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:Failed to read vbus voltage:%d\n", __func__, ret);
+		return ret;
+	}
+
+	return __bq2589x_set_charge_profile(bq, adc.vbus);
+}
+
+
+static const char * const bq2589x_state_names[] = {
+	[BQ2589X_STATE_ABSENT]		= "absent",
+	[BQ2589X_STATE_PRECHG_WAIT]	= "precharge wait",
+	[BQ2589X_STATE_FAST]		= "fast charge",
+	[BQ2589X_STATE_DONE]		= "done",
+	[BQ2589X_STATE_FAULT]		= "fault",
+	[BQ2589X_STATE_THERMAL_LIMIT]	= "thermal limit",
+};
+
+/* states in which the slave is enabled and its watchdog is armed */
+static bool bq2589x_state_charging(enum bq2589x_chg_state state)
+{
+	return state == BQ2589X_STATE_FAST || state == BQ2589X_STATE_THERMAL_LIMIT;
+}
+
+/*
+ * While charging, the poll is what resets the 40s chip watchdog, so it must
+ * not wait for an idle CPU to wake up; otherwise it may.
+ */
+static void bq2589x_schedule_monitor(struct bq2589x *bq, unsigned int ms)
+{
+	struct delayed_work *work = &bq->monitor_work;
+	struct delayed_work *other = &bq->monitor_idle_work;
+
+	if (!bq2589x_state_charging(bq->state))
+		swap(work, other);
+
+	cancel_delayed_work(other);
+	mod_delayed_work(bq->wq, work, msecs_to_jiffies(ms));
+}
+
+/* the monitor keeps the ADC converting for as long as it runs */
+static void bq2589x_start_monitor(struct bq2589x *bq)
+{
+	if (!bq->monitor_active) {
+		bq->monitor_active = true;
+		bq2589x_adc_get(bq);
+	}
+	bq->monitor_interval = BQ2589X_MON_NORMAL_MS;
+	bq2589x_schedule_monitor(bq, BQ2589X_MON_NORMAL_MS);
+}
+
+/*
+ * Runs on the ordered workqueue, so the monitor work can't be executing;
+ * a poll event it already posted is ignored once we are absent.
+ */
+static void bq2589x_stop_monitor(struct bq2589x *bq)
+{
+	cancel_delayed_work(&bq->monitor_work);
+	cancel_delayed_work(&bq->monitor_idle_work);
+	if (bq->monitor_active) {
+		bq->monitor_active = false;
+		bq2589x_adc_put(bq);
+	}
+}
+
+/* charger enable and watchdog for @state, unchanged fields cost no I/O */
+static int bq2589x_write_state_regs(struct bq2589x *bq, enum bq2589x_chg_state state)
+{
+	bool charging = bq2589x_state_charging(state);
+	struct bq2589x_field_val vals[] = {
+		{ BQ2589X_F_CHG_CONFIG,	charging ? BQ25898S_CHG_ENABLE : BQ25898S_CHG_DISABLE },
+		{ BQ2589X_F_WDT,	charging ? BQ25898S_WDT_40S : BQ25898S_WDT_DISABLE },
+	};
+
+	return bq2589x_fields_write(bq, vals, ARRAY_SIZE(vals));
+}
+
+/* session bookkeeping for a transition, called from the state machine */
+static void bq2589x_session_state(struct bq2589x *bq, enum bq2589x_chg_state old,
+				enum bq2589x_chg_state state)
+{
+	struct bq2589x_session *ss = &bq->session;
+	ktime_t now = ktime_get_boottime();
+
+	mutex_lock(&bq->session_lock);
+	if (old == BQ2589X_STATE_ABSENT) {
+		memset(ss, 0, sizeof(*ss));
+		ss->active = true;
+		ss->start = now;
+		ss->last = now;
+		ss->time_to_full = -1;
+		ss->ts_min = INT_MAX;
+	}
+
+	switch (state) {
+	case BQ2589X_STATE_ABSENT:
+		ss->active = false;
+		ss->last = now;
+		break;
+	case BQ2589X_STATE_DONE:
+		if (ss->time_to_full < 0)
+			ss->time_to_full = ktime_to_ms(ktime_sub(now, ss->start));
+		break;
+	case BQ2589X_STATE_THERMAL_LIMIT:
+		ss->thermal_events++;
+		break;
+	case BQ2589X_STATE_FAULT:
+		ss->faults++;
+		break;
+	default:
+		break;
+	}
+	mutex_unlock(&bq->session_lock);
+}
+
+/* fold a monitor sample into the session, DPM events count rising edges */
+static void bq2589x_session_sample(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	struct bq2589x_session *ss = &bq->session;
+	ktime_t now = ktime_get_boottime();
+
+	mutex_lock(&bq->session_lock);
+	if (!ss->active)
+		goto out;
+
+	if (!ss->vbat_start)
+		ss->vbat_start = adc->vbat;
+	ss->ichg_max = max(ss->ichg_max, adc->ichg);
+	ss->ts_min = min(ss->ts_min, adc->ts_pct);
+	ss->charge += (u64)adc->ichg * ktime_to_ms(ktime_sub(now, ss->last));
+	ss->last = now;
+
+	if (adc->vdpm && !ss->vdpm)
+		ss->vdpm_events++;
+	if (adc->idpm && !ss->idpm)
+		ss->idpm_events++;
+	ss->vdpm = adc->vdpm;
+	ss->idpm = adc->idpm;
+out:
+	mutex_unlock(&bq->session_lock);
+}
+
+static int bq2589x_set_state(struct bq2589x *bq, enum bq2589x_chg_state state)
+{
+	enum bq2589x_chg_state old = bq->state;
+	int ret = 0;
+
+	if (state == old)
+		return 0;
+
+	if (bq2589x_state_charging(state) != bq2589x_state_charging(old)) {
+		ret = bq2589x_write_state_regs(bq, state);
+		if (ret < 0) {
+			dev_err(bq->dev, "%s:Failed to enter %s:%d\n", __func__,
+					bq2589x_state_names[state], ret);
+			return ret;
+		}
+	}
+
+	bq2589x_session_state(bq, old, state);
+	WRITE_ONCE(bq->state, state);
+
+	/* the poll timer depends on whether the watchdog is armed */
+	if (old == BQ2589X_STATE_ABSENT)
+		bq2589x_start_monitor(bq);
+	else if (state == BQ2589X_STATE_ABSENT)
+		bq2589x_stop_monitor(bq);
+	else if (bq2589x_state_charging(state) != bq2589x_state_charging(old))
+		bq2589x_schedule_monitor(bq, bq->monitor_interval);
+	dev_info(bq->dev, "%s:%s -> %s\n", __func__,
+			bq2589x_state_names[old], bq2589x_state_names[state]);
+	power_supply_changed(&bq->psy);
+
+	return 0;
+}
+
+/* start over from the configured input limit, e.g. for a new adapter */
+static void bq2589x_aicl_reset(struct bq2589x *bq)
+{
+	bq->aicl_limit = bq->cfg.iindpm_threshold;
+	bq->aicl_ceiling = min(bq->cfg.aicl_max_current,
+			bq2589x_fields[BQ2589X_F_IINLIM].max);
+	bq->aicl_step = BQ2589X_AICL_STEP_MAX;
+	bq->aicl_hold = 0;
+}
+
+/*
+ * Raise IINLIM while the chip reports it is input current limited and VBUS
+ * holds up; back off below the effective limit as soon as VBUS sags into
+ * VINDPM and remember that point as the new ceiling.
+ */
+static void bq2589x_aicl_step(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	int limit = bq->aicl_limit;
+	int cap = bq->aicl_ceiling;
+
+	if (!bq->cfg.aicl_max_current)
+		return;
+
+	/* input current limited because cooling asked for it, nothing to find */
+	if (bq->thermal_iinlim >= 0)
+		cap = min(cap, bq->thermal_iinlim);
+
+	if (adc->vdpm) {
+		bq->aicl_ceiling = max(limit - BQ2589X_AICL_STEP_MIN, BQ2589X_AICL_MIN_MA);
+		limit = max(min(limit, adc->idpm_lim) - bq->aicl_step, BQ2589X_AICL_MIN_MA);
+		bq->aicl_step = max(bq->aicl_step / 2, BQ2589X_AICL_STEP_MIN);
+		bq->aicl_hold = BQ2589X_AICL_HOLD;
+	} else if (bq->aicl_hold) {
+		bq->aicl_hold--;
+		return;
+	} else if (adc->idpm && limit < cap) {
+		limit = min(limit + bq->aicl_step, cap);
+	}
+
+	if (limit == bq->aicl_limit)
+		return;
+
+	dev_info(bq->dev, "%s:input current limit %d -> %d mA\n", __func__, bq->aicl_limit, limit);
+	bq->aicl_limit = limit;
+	bq2589x_update_iinlim(bq);
+}
+
+/*
+ * Follow VBUS, e.g. after the adapter negotiated a higher voltage, but only
+ * once it moved out of the hysteresis band. VBUS sagging because the input
+ * loop is regulating says nothing about the adapter, so never lower the
+ * threshold while VDPM is active.
+ */
+static void bq2589x_track_vindpm(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	int target;
+	int ret;
+
+	if (!adc->vbus_gd)
+		return;
+
+	target = bq2589x_vindpm_for_vbus(bq, adc->vbus);
+	if (abs(target - bq->vindpm) < BQ2589X_VINDPM_HYST)
+		return;
+	if (target < bq->vindpm && adc->vdpm)
+		return;
+
+	ret = bq2589x_field_write(bq, BQ2589X_F_VINDPM, target);
+	if (ret) {
+		dev_err(bq->dev, "%s:Failed to set vindpm:%d\n", __func__, ret);
+		return;
+	}
+
+	dev_info(bq->dev, "%s:vbus %d mV, vindpm %d -> %d mV\n", __func__,
+			adc->vbus, bq->vindpm, target);
+	bq->vindpm = target;
+}
+
+/*
+ * Our part of the total the master asked for, capped by what we are set up
+ * for; the cooling device's limit is a vote of its own, so it cuts the share
+ * as far as the cooling state says. While the chip is in thermal regulation
+ * it can't deliver its share, so cap it at the measured current plus a
+ * margin and leave the rest to the master. The margin keeps the limit from
+ * ratcheting down on every poll and lets it climb back as the die cools.
+ */
+static void bq2589x_share_update(struct bq2589x *bq)
+{
+	struct bq2589x_telemetry tlm;
+	int total;
+	int share = -1;
+
+	spin_lock_irq(&bq->req_lock);
+	total = bq->req_total;
+	spin_unlock_irq(&bq->req_lock);
+
+	bq2589x_get_telemetry(bq, &tlm);
+
+	if (total >= 0) {
+		share = total * bq->cfg.share_pct / 100;
+		if (bq->state == BQ2589X_STATE_THERMAL_LIMIT && tlm.valid)
+			share = min(share, tlm.adc.ichg + BQ2589X_SHARE_MARGIN);
+	}
+	bq2589x_vote_ichg(bq, BQ2589X_ICHG_VOTE_SHARE, share);
+
+	if (bq2589x_state_charging(bq->state) && tlm.valid)
+		WRITE_ONCE(bq->share_achieved, min(tlm.adc.ichg, bq->ichg));
+	else
+		WRITE_ONCE(bq->share_achieved, 0);
+}
+
+/* entry for @vbat, the first one also covers everything below it */
+static int bq2589x_step_index(struct bq2589x *bq, int vbat)
+{
+	int i;
+
+	for (i = bq->cfg.step_num - 1; i > 0; i--) {
+		if (vbat >= bq->cfg.step[i].vbat)
+			break;
+	}
+
+	return i;
+}
+
+/* pick the entry from scratch, the next profile write programs it */
+static void bq2589x_step_reset(struct bq2589x *bq, int vbat)
+{
+	if (!bq->cfg.step_num)
+		return;
+
+	bq->step_idx = bq2589x_step_index(bq, vbat);
+	bq->step_stamp = jiffies;
+	bq->ichg_votes[BQ2589X_ICHG_VOTE_STEP] = bq->cfg.step[bq->step_idx].ichg;
+}
+
+static void bq2589x_step_update(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	const struct bq2589x_step *step = bq->cfg.step;
+	int idx = bq->step_idx;
+
+	if (!bq->cfg.step_num)
+		return;
+
+	if (time_before(jiffies, bq->step_stamp + msecs_to_jiffies(BQ2589X_STEP_MIN_MS)))
+		return;
+
+	if (idx + 1 < bq->cfg.step_num && adc->vbat >= step[idx + 1].vbat)
+		idx++;
+	else if (idx > 0 && adc->vbat < step[idx].vbat - BQ2589X_STEP_HYST)
+		idx--;
+	else
+		return;
+
+	dev_info(bq->dev, "%s:vbat %d mV, charge current %d -> %d mA\n", __func__,
+			adc->vbat, step[bq->step_idx].ichg, step[idx].ichg);
+	bq->step_idx = idx;
+	bq->step_stamp = jiffies;
+	bq2589x_vote_ichg(bq, BQ2589X_ICHG_VOTE_STEP, step[idx].ichg);
+}
+
+static int bq2589x_jeita_find(struct bq2589x *bq, int ts)
+{
+	int i;
+
+	for (i = 0; i < bq->cfg.jeita_num; i++) {
+		if (ts >= bq->cfg.jeita[i].ts_min && ts < bq->cfg.jeita[i].ts_max)
+			return i;
+	}
+
+	return -1;
+}
+
+/* outside every zone the battery is too hot or too cold to charge */
+static void bq2589x_jeita_select(struct bq2589x *bq, int zone)
+{
+	bq->jeita_zone = zone;
+	if (zone >= 0) {
+		bq->jeita_vreg = bq->cfg.jeita[zone].vreg;
+		bq->ichg_votes[BQ2589X_ICHG_VOTE_JEITA] = bq->cfg.jeita[zone].ichg;
+	} else {
+		bq->jeita_vreg = -1;
+		bq->ichg_votes[BQ2589X_ICHG_VOTE_JEITA] = 0;
+	}
+}
+
+/*
+ * Stay in the current zone until TS left it by the hysteresis, then apply
+ * the new zone's image; only VREG and ICHG are in it, so at most two
+ * registers get written, and only those that differ.
+ */
+static void bq2589x_jeita_update(struct bq2589x *bq, const struct bq2589x_adc_data *adc)
+{
+	const struct bq2589x_jeita_zone *z;
+	struct bq2589x_reg_image img;
+	int zone;
+	int ichg;
+	int ret;
+
+	if (!bq->cfg.jeita_num)
+		return;
+
+	if (bq->jeita_zone >= 0) {
+		z = &bq->cfg.jeita[bq->jeita_zone];
+		if (adc->ts_pct >= z->ts_min - BQ2589X_JEITA_HYST &&
+		    adc->ts_pct < z->ts_max + BQ2589X_JEITA_HYST)
+			return;
+	}
+
+	zone = bq2589x_jeita_find(bq, adc->ts_pct);
+	if (zone == bq->jeita_zone)
+		return;
+
+	dev_info(bq->dev, "%s:TS %d.%03d%%, jeita zone %d -> %d\n", __func__,
+			adc->ts_pct / 1000, adc->ts_pct % 1000, bq->jeita_zone, zone);
+	bq2589x_jeita_select(bq, zone);
+
+	if (zone >= 0) {
+		img = bq->cfg.jeita[zone].img;
+	} else {
+		memset(&img, 0, sizeof(img));
+		bq2589x_image_set_field(&img, BQ2589X_F_VREG, bq->cfg.charge_voltage);
+	}
+
+	/* the zone's current is just one vote, program the winner */
+	ichg = bq2589x_ichg_effective(bq);
+	bq2589x_image_set_field(&img, BQ2589X_F_ICHG, ichg);
+
+	ret = bq2589x_apply_image(bq, &img);
+	if (ret < 0) {
+		dev_err(bq->dev, "%s:Failed to apply jeita zone:%d\n", __func__, ret);
+		return;
+	}
+	bq->ichg = ichg;
+}
+
+/* where an attached adapter should leave us, given fresh ADC data */
+static enum bq2589x_chg_state bq2589x_pick_state(struct bq2589x *bq,
+				const struct bq2589x_adc_data *adc)
+{
+	if (adc->vbat < BQ2589X_PRECHG_VOLT)
+		return BQ2589X_STATE_PRECHG_WAIT;
+
+	if (adc->therm_stat)
+		return BQ2589X_STATE_THERMAL_LIMIT;
+
+	return BQ2589X_STATE_FAST;
+}
+
+static int bq2589x_sm_adapter_in(struct bq2589x *bq)
+{
+	struct bq2589x_adc_data adc;
+	enum bq2589x_chg_state state;
+	int ret;
+
+	ret = bq2589x_read_adc(bq, &adc);
+	if (ret < 0){
+		dev_err(bq->dev, "Failed to read battery voltage");
+		return ret;
+	}
+
+	/* applied on every plug-in, the new adapter may need another VINDPM */
+	bq2589x_step_reset(bq, adc.vbat);
+	bq2589x_aicl_reset(bq);
+	if (bq->cfg.jeita_num)
+		bq2589x_jeita_select(bq, bq2589x_jeita_find(bq, adc.ts_pct));
+	ret = __bq2589x_set_charge_profile(bq, adc.vbus);
+	if (ret < 0)
+		return ret;
+
+	state = bq2589x_pick_state(bq, &adc);
+	if (state != BQ2589X_STATE_PRECHG_WAIT && bq->state == BQ2589X_STATE_ABSENT) {
+		/* check if battery is near full, if so, no need to turn on slave charge */
+		if (bq->rsoc < 0)
+			bq2589x_update_rsoc(bq);
+		if (bq2589x_battery_full(bq)) {
+			dev_info(bq->dev, "%s:RSOC=%d, no need start slave charger\n", __func__, bq->rsoc);
+			state = BQ2589X_STATE_DONE;
+		}
+	}
+
+	if (bq->state != BQ2589X_STATE_ABSENT && bq->state != BQ2589X_STATE_PRECHG_WAIT)
+		return 0;
+
+	return bq2589x_set_state(bq, state);
+}
+
+/* bring the chip back to our settings after its watchdog reset them */
+static int bq2589x_sm_restore(struct bq2589x *bq)
+{
+	int ret;
+
+	ret = bq2589x_init_device(bq);
+	if (ret)
+		return ret;
+
+	ret = bq2589x_set_charge_profile(bq);
+	if (ret < 0)
+		return ret;
+
+	ret = bq2589x_write_state_regs(bq, bq->state);
+	return ret < 0 ? ret : 0;
+}
+
+static void bq2589x_irq_account(struct bq2589x *bq)
+{
+	s64 latency;
+
+	latency = ktime_us_delta(ktime_get(), bq->irq_stamp);
+	bq->irq_count++;
+	bq->irq_latency_last = latency;
+	bq->irq_latency_total += latency;
+	if (latency > bq->irq_latency_max)
+		bq->irq_latency_max = latency;
+	dev_dbg(bq->dev, "%s:handled in %lld us\n", __func__, latency);
+}
+
+/* act on STATUS/FAULT as read by the interrupt thread or the poll */
+static void bq2589x_sm_handle_status(struct bq2589x *bq, u8 status, u8 fault)
+{
+	struct bq2589x_adc_data adc;
+	u8 charge_status;
+	int ret;
+
+	if (fault)
+		dev_info(bq->dev, "%s:charge fault:%02x\n", __func__,fault);
+
+	if (fault & BQ25898S_FAULT_WDT_MASK) {
+		/* control registers are back to their defaults */
+		bq2589x_cache_invalidate(bq);
+		if (bq->state != BQ2589X_STATE_ABSENT) {
+			ret = bq2589x_sm_restore(bq);
+			if (ret)
+				dev_err(bq->dev, "%s:Failed to restore charging:%d\n", __func__, ret);
+		}
+	}
+
+	if (bq->state == BQ2589X_STATE_ABSENT)
+		return;
+
+	charge_status = (status & BQ25898S_CHRG_STAT_MASK) >> BQ25898S_CHRG_STAT_SHIFT;
+	if (fault & ~BQ25898S_FAULT_WDT_MASK) {
+		bq2589x_set_state(bq, BQ2589X_STATE_FAULT);
+	} else if (bq->state == BQ2589X_STATE_FAULT) {
+		if (!bq2589x_read_adc(bq, &adc))
+			bq2589x_set_state(bq, bq2589x_pick_state(bq, &adc));
+	} else if (charge_status == BQ25898S_CHRG_STAT_CHGDONE &&
+			bq2589x_state_charging(bq->state)) {
+		dev_info(bq->dev, "%s:charge done!\n", __func__);
+		bq2589x_set_state(bq, BQ2589X_STATE_DONE);
+	}
+}
+
+/* without an interrupt line, status changes are only seen by the poll */
+static void bq2589x_sm_status(struct bq2589x *bq)
+{
+	u8 buf[2];
+	int ret;
+
+	/* STATUS and FAULT are adjacent, fetch both in one transaction */
+	ret = bq2589x_read_block(bq, BQ25898S_REG_0B, buf, 2);
+	if (ret)
+		return;
+
+	if (bq2589x_publish_status(bq, buf[0], buf[1]))
+		power_supply_changed(&bq->psy);
+
+	bq2589x_sm_handle_status(bq, buf[0], buf[1]);
+}
+
+/* the rest of an interrupt, after the thread read and published the status */
+static void bq2589x_sm_irq(struct bq2589x *bq)
+{
+	u8 status;
+	u8 fault;
+
+	spin_lock_irq(&bq->req_lock);
+	status = bq->irq_status;
+	fault = bq->irq_fault;
+	bq->irq_fault = 0;
+	spin_unlock_irq(&bq->req_lock);
+
+	bq2589x_sm_handle_status(bq, status, fault);
+}
+
+/*
+ * Poll quickly while the input is in DPM regulation, the chip is in thermal
+ * regulation or the battery is close to the precharge threshold, otherwise
+ * back off towards the slow interval.
+ */
+static unsigned int bq2589x_monitor_interval(struct bq2589x *bq,
+				const struct bq2589x_adc_data *adc)
+{
+	if (adc->vdpm || adc->idpm || adc->therm_stat)
+		return BQ2589X_MON_FAST_MS;
+
+	if (abs(adc->vbat - BQ2589X_PRECHG_VOLT) <= BQ2589X_PRECHG_WINDOW)
+		return BQ2589X_MON_FAST_MS;
+
+	if (bq->monitor_interval < BQ2589X_MON_NORMAL_MS)
+		return BQ2589X_MON_NORMAL_MS;
+
+	return min_t(unsigned int, bq->monitor_interval * 2, BQ2589X_MON_SLOW_MS);
+}
+
+static void bq2589x_sm_poll(struct bq2589x *bq)
+{
+	struct bq2589x_adc_data adc;
+	unsigned int interval = BQ2589X_MON_NORMAL_MS;
+	u8 fault;
+	int ret;
+
+	if (bq->state == BQ2589X_STATE_ABSENT)
+		return;
+
+	ret = bq2589x_read_adc(bq, &adc);
+	if (ret)
+		goto out;
+
+	bq2589x_session_sample(bq, &adc);
+
+	/* without an interrupt line, status changes are only seen here */
+	if (bq->client->irq <= 0)
+		bq2589x_sm_status(bq);
+
+	interval = bq2589x_monitor_interval(bq, &adc);
+	bq2589x_track_vindpm(bq, &adc);
+	bq2589x_jeita_update(bq, &adc);
+
+	switch (bq->state) {
+	case BQ2589X_STATE_PRECHG_WAIT:
+		if (adc.vbat >= BQ2589X_PRECHG_VOLT)
+			bq2589x_set_state(bq, bq2589x_pick_state(bq, &adc));
+		break;
+	case BQ2589X_STATE_FAST:
+		if (adc.therm_stat)
+			bq2589x_set_state(bq, BQ2589X_STATE_THERMAL_LIMIT);
+		break;
+	case BQ2589X_STATE_THERMAL_LIMIT:
+		if (!adc.therm_stat)
+			bq2589x_set_state(bq, BQ2589X_STATE_FAST);
+		break;
+	case BQ2589X_STATE_FAULT:
+		/* a fault going away doesn't necessarily raise an interrupt */
+		ret = bq2589x_read_byte(bq, &fault, BQ25898S_REG_0C);
+		if (!ret && !(fault & ~BQ25898S_FAULT_WDT_MASK))
+			bq2589x_set_state(bq, bq2589x_pick_state(bq, &adc));
+		break;
+	default:
+		break;
+	}
+
+	bq2589x_share_update(bq);
+
+	if (bq2589x_state_charging(bq->state)) {
+		bq2589x_step_update(bq, &adc);
+		bq2589x_aicl_step(bq, &adc);
+		bq2589x_reset_watchdog_timer(bq);
+	}
+
+	dev_info(bq->dev, "%s:vbus volt:%d,vbat volt:%d,charge current:%d\n", __func__, adc.vbus, adc.vbat, adc.ichg);
+
+	if (adc.vdpm)
+		dev_info(bq->dev, "%s:VINDPM occurred\n", __func__);
+	if (adc.idpm)
+		dev_info(bq->dev, "%s:IINDPM occurred\n", __func__);
+
+out:
+	if (bq->state == BQ2589X_STATE_ABSENT)
+		return;
+	bq->monitor_interval = interval;
+	bq2589x_schedule_monitor(bq, interval);
+}
+
+/* apply the capacity cutoff whenever the battery reports a change */
+static void bq2589x_sm_battery(struct bq2589x *bq)
+{
+	struct bq2589x_adc_data adc;
+	int old = bq->rsoc;
+
+	if (bq2589x_update_rsoc(bq) || bq->rsoc == old)
+		return;
+
+	if (bq2589x_state_charging(bq->state) && bq2589x_battery_full(bq)) {
+		dev_info(bq->dev, "%s:RSOC=%d, stop slave charger\n", __func__, bq->rsoc);
+		bq2589x_set_state(bq, BQ2589X_STATE_DONE);
+	} else if (bq->state == BQ2589X_STATE_DONE && bq->rsoc < BQ2589X_RSOC_RESUME) {
+		dev_info(bq->dev, "%s:RSOC=%d, restart slave charger\n", __func__, bq->rsoc);
+		if (!bq2589x_read_adc(bq, &adc))
+			bq2589x_set_state(bq, bq2589x_pick_state(bq, &adc));
+	}
+}
+
+/*
+ * power_supply notifiers run in atomic context and the gauge may sit on a
+ * bus, so only note the change here and read the capacity from the queue.
+ */
+static int bq2589x_batt_notifier_call(struct notifier_block *nb,
+				unsigned long event, void *data)
+{
+	struct bq2589x *bq = container_of(nb, struct bq2589x, batt_nb);
+	struct power_supply *psy = data;
+
+	if (event != PSY_EVENT_PROP_CHANGED || strcmp(psy->name, "battery"))
+		return NOTIFY_DONE;
+
+	bq2589x_post_event(bq, BQ2589X_EVT_BATTERY);
+	return NOTIFY_OK;
+}
+
+static void bq2589x_thermal_update(struct bq2589x *bq)
+{
+	const struct bq2589x_thermal_level *level;
+	unsigned long state;
+
+	spin_lock_irq(&bq->req_lock);
+	state = bq->req_thermal;
+	spin_unlock_irq(&bq->req_lock);
+
+	if (state == bq->thermal_cur)
+		return;
+
+	level = &bq->cfg.thermal[state];
+	dev_dbg(bq->dev, "%s:cooling state %lu -> %lu\n", __func__, bq->thermal_cur, state);
+	bq->thermal_cur = state;
+
+	/*
+	 * ICHG (REG_04) and IINLIM (REG_00) are separate writes, each made
+	 * only if the effective limit actually moves; levels sharing an
+	 * input limit don't touch IINLIM at all.
+	 */
+	bq2589x_vote_ichg(bq, BQ2589X_ICHG_VOTE_THERMAL, level->ichg);
+	if (level->iinlim != bq->thermal_iinlim) {
+		bq->thermal_iinlim = level->iinlim;
+		bq2589x_update_iinlim(bq);
+	}
+}
+
+static int bq2589x_cdev_get_max_state(struct thermal_cooling_device *cdev,
+				unsigned long *state)
+{
+	struct bq2589x *bq = cdev->devdata;
+
+	*state = bq->cfg.thermal_levels - 1;
+	return 0;
+}
+
+static int bq2589x_cdev_get_cur_state(struct thermal_cooling_device *cdev,
+				unsigned long *state)
+{
+	struct bq2589x *bq = cdev->devdata;
+
+	*state = READ_ONCE(bq->req_thermal);
+	return 0;
+}
+
+static int bq2589x_cdev_set_cur_state(struct thermal_cooling_device *cdev,
+				unsigned long state)
+{
+	struct bq2589x *bq = cdev->devdata;
+
+	if (state >= bq->cfg.thermal_levels)
+		return -EINVAL;
+
+	spin_lock_irq(&bq->req_lock);
+	bq->req_thermal = state;
+	spin_unlock_irq(&bq->req_lock);
+
+	bq2589x_post_event(bq, BQ2589X_EVT_THERMAL);
+	return 0;
+}
+
+static const struct thermal_cooling_device_ops bq2589x_cdev_ops = {
+	.get_max_state	= bq2589x_cdev_get_max_state,
+	.get_cur_state	= bq2589x_cdev_get_cur_state,
+	.set_cur_state	= bq2589x_cdev_set_cur_state,
+};
+
+/*
+ * The only place charging state changes. Adapter notifications, interrupts
+ * and monitor ticks all funnel in here as events on the ordered workqueue,
+ * so they never race each other on the bus or on bq->state.
+ */
+static void bq2589x_event_workfunc(struct work_struct *work)
+{
+	struct bq2589x *bq = container_of(work, struct bq2589x, event_work);
+	bq2589x_adapter_cb_t cb = NULL;
+	void *data = NULL;
+	unsigned long events;
+	bool present = false;
+	ktime_t start;
+	int ret;
+
+	spin_lock_irq(&bq->req_lock);
+	events = bq->events;
+	bq->events = 0;
+	if (events & BQ2589X_EVT_ADAPTER) {
+		present = bq->req_present;
+		cb = bq->req_cb;
+		data = bq->req_data;
+		bq->req_cb = NULL;
+		bq->req_data = NULL;
+	}
+	spin_unlock_irq(&bq->req_lock);
+
+	if (events & BQ2589X_EVT_ADAPTER) {
+		if (present) {
+			start = bq2589x_op_begin(bq, BQ2589X_OP_ADAPTER_IN);
+			ret = bq2589x_sm_adapter_in(bq);
+			bq2589x_op_end(bq, BQ2589X_OP_ADAPTER_IN, start);
+		} else {
+			start = bq2589x_op_begin(bq, BQ2589X_OP_ADAPTER_OUT);
+			ret = bq2589x_set_state(bq, BQ2589X_STATE_ABSENT);
+			bq2589x_op_end(bq, BQ2589X_OP_ADAPTER_OUT, start);
+			if (!ret)
+				dev_info(bq->dev, "%s:slave charge stopped\n", __func__);
+		}
+		if (cb)
+			cb(data, present, ret);
+	}
+
+	if (events & BQ2589X_EVT_IRQ)
+		bq2589x_sm_irq(bq);
+
+	if (events & BQ2589X_EVT_BATTERY)
+		bq2589x_sm_battery(bq);
+
+	if (events & BQ2589X_EVT_SHARE)
+		bq2589x_share_update(bq);
+
+	if (events & BQ2589X_EVT_THERMAL)
+		bq2589x_thermal_update(bq);
+
+	if (events & BQ2589X_EVT_POLL) {
+		start = bq2589x_op_begin(bq, BQ2589X_OP_MONITOR);
+		bq2589x_sm_poll(bq);
+		bq2589x_op_end(bq, BQ2589X_OP_MONITOR, start);
+	}
+}
+
+static void bq2589x_monitor_workfunc(struct work_struct *work)
+{
+	struct bq2589x *bq = container_of(work, struct bq2589x, monitor_work.work);
+
+	bq2589x_post_event(bq, BQ2589X_EVT_POLL);
+}
+
+static void bq2589x_monitor_idle_workfunc(struct work_struct *work)
+{
+	struct bq2589x *bq = container_of(work, struct bq2589x, monitor_idle_work.work);
+
+	bq2589x_post_event(bq, BQ2589X_EVT_POLL);
+}
+
+/* the last reference is gone, from remove or a bq2589x_put() after it */
+static void bq2589x_release(struct kref *ref)
+{
+	struct bq2589x *bq = container_of(ref, struct bq2589x, ref);
+
+	mutex_destroy(&bq->session_lock);
+	mutex_destroy(&bq->adc_lock);
+	mutex_destroy(&bq->i2c_lock);
+	put_device(bq->dev);
+	kfree(bq);
+}
+
+/**
+ * bq2589x_find_by_node - look up a probed slave charger
+ * @np: device tree node of the slave, e.g. from a phandle in the master node
+ *
+ * Returns the instance bound to @np with a reference held, or NULL if it has
+ * not been probed yet. Drop the reference with bq2589x_put(). The instance
+ * stays valid until then, but once the driver is unbound the requests fail
+ * with -ESHUTDOWN.
+ */
+struct bq2589x *bq2589x_find_by_node(struct device_node *np)
+{
+	struct bq2589x *bq;
+	struct bq2589x *found = NULL;
+
+	mutex_lock(&bq2589x_list_lock);
+	list_for_each_entry(bq, &bq2589x_list, list) {
+		if (bq->dev->of_node == np) {
+			kref_get(&bq->ref);
+			found = bq;
+			break;
+		}
+	}
+	mutex_unlock(&bq2589x_list_lock);
+
+	return found;
+}
+EXPORT_SYMBOL_GPL(bq2589x_find_by_node);
+
+/**
+ * bq2589x_put - release an instance returned by bq2589x_find_by_node()
+ * @bq: slave charger instance
+ */
+void bq2589x_put(struct bq2589x *bq)
+{
+	kref_put(&bq->ref, bq2589x_release);
+}
+EXPORT_SYMBOL_GPL(bq2589x_put);
+
+/**
+ * bq2589x_adapter_notify - queue an adapter insertion or removal
+ * @bq: slave charger instance
+ * @present: true when the adapter was plugged in, false when removed
+ * @cb: optional completion callback, see bq2589x_adapter_cb_t
+ * @data: passed back to @cb
+ *
+ * Safe to call from atomic notifier context, all bus traffic happens on the
+ * driver's workqueue. Notifications arriving before the state machine runs
+ * collapse into the last one, so an in/out/in bounce is applied as a single
+ * adapter-in; the callbacks of superseded notifications are called with
+ * -ECANCELED from this call, in the caller's context.
+ *
+ * Returns -ESHUTDOWN without calling @cb once the driver is being removed.
+ */
+int bq2589x_adapter_notify(struct bq2589x *bq, bool present,
+			bq2589x_adapter_cb_t cb, void *data)
+{
+	bq2589x_adapter_cb_t old_cb;
+	void *old_data;
+	bool old_present;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bq->req_lock, flags);
+	if (bq->stopping) {
+		spin_unlock_irqrestore(&bq->req_lock, flags);
+		return -ESHUTDOWN;
+	}
+	old_cb = bq->req_cb;
+	old_data = bq->req_data;
+	old_present = bq->req_present;
+	bq->req_present = present;
+	bq->req_cb = cb;
+	bq->req_data = data;
+	bq->events |= BQ2589X_EVT_ADAPTER;
+	queue_work(bq->wq, &bq->event_work);
+	spin_unlock_irqrestore(&bq->req_lock, flags);
+
+	if (old_cb)
+		old_cb(old_data, old_present, -ECANCELED);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_adapter_notify);
+
+/**
+ * bq2589x_request_total_current - share a parallel charge current
+ * @bq: slave charger instance
+ * @total_ma: total charge current master and slave should deliver together,
+ *	or a negative value to go back to the DT charge current
+ *
+ * The slave takes its ti,bq2589x,current-share percentage of @total_ma,
+ * less while it is thermally limited. The request is applied from the
+ * driver's workqueue, poll bq2589x_get_current_share() for the result.
+ * Returns -ESHUTDOWN once the driver is being removed.
+ */
+int bq2589x_request_total_current(struct bq2589x *bq, int total_ma)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bq->req_lock, flags);
+	if (bq->stopping) {
+		spin_unlock_irqrestore(&bq->req_lock, flags);
+		return -ESHUTDOWN;
+	}
+	bq->req_total = total_ma;
+	bq->events |= BQ2589X_EVT_SHARE;
+	queue_work(bq->wq, &bq->event_work);
+	spin_unlock_irqrestore(&bq->req_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bq2589x_request_total_current);
+
+/**
+ * bq2589x_get_current_share - charge current the slave actually delivers
+ * @bq: slave charger instance
+ *
+ * Returns the measured charge current in mA as of the last monitor poll,
+ * capped at the programmed value, or 0 while the slave isn't charging. The
+ * master should make up the difference to the requested total.
+ */
+int bq2589x_get_current_share(struct bq2589x *bq)
+{
+	return READ_ONCE(bq->share_achieved);
+}
+EXPORT_SYMBOL_GPL(bq2589x_get_current_share);
+
+struct bq2589x_adapter_sync {
+	struct completion	done;
+	int			ret;
+};
+
+static void bq2589x_adapter_sync_done(void *data, bool present, int ret)
+{
+	struct bq2589x_adapter_sync *sync = data;
+
+	sync->ret = ret;
+	complete(&sync->done);
+}
+
+/* the synchronous calls wait for the state machine, must not be used from it */
+static int bq2589x_adapter_sync(struct bq2589x *bq, bool present)
+{
+	struct bq2589x_adapter_sync sync;
+	int ret;
+
+	init_completion(&sync.done);
+	ret = bq2589x_adapter_notify(bq, present, bq2589x_adapter_sync_done, &sync);
+	if (ret)
+		return ret;
+	wait_for_completion(&sync.done);
+
+	return sync.ret;
+}
+
+int bq2589x_adapter_in(struct bq2589x *bq)
+{
+	return bq2589x_adapter_sync(bq, true);
+}
+EXPORT_SYMBOL_GPL(bq2589x_adapter_in);
+
+int bq2589x_adapter_out(struct bq2589x *bq)
+{
+	return bq2589x_adapter_sync(bq, false);
+}
+EXPORT_SYMBOL_GPL(bq2589x_adapter_out);
+
+/*
+ * Stop the state machine, e.g. on removal; a queued notification never runs
+ * and nothing can be queued from here on.
+ */
+static void bq2589x_sm_stop(struct bq2589x *bq)
+{
+	bq2589x_adapter_cb_t cb;
+	void *data;
+	bool present;
 
-	ret = bq2589x_enable_term(bq, bq->cfg.enable_term);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to enable/disable termination:%d\n", __func__, ret);
-		return ret;
-	}
+	spin_lock_irq(&bq->req_lock);
+	bq->stopping = true;
+	spin_unlock_irq(&bq->req_lock);
 
+	cancel_work_sync(&bq->event_work);
+	/* a running event may have rearmed the monitor */
+	cancel_delayed_work_sync(&bq->monitor_work);
+	cancel_delayed_work_sync(&bq->monitor_idle_work);
 
-	ret = bq2589x_set_absolute_vindpm(bq,true); /* use absolute mode vindpm setting*/
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to enable absolute vindpm:%d\n", __func__, ret);
-		return ret;
-	}
+	spin_lock_irq(&bq->req_lock);
+	cb = bq->req_cb;
+	data = bq->req_data;
+	present = bq->req_present;
+	bq->req_cb = NULL;
+	spin_unlock_irq(&bq->req_lock);
 
-	ret = bq2589x_disable_charger(bq);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to disable charger:%d\n", __func__, ret);
-		return ret;
-	}
+	if (cb)
+		cb(data, present, -ECANCELED);
 
-	ret = bq2589x_adc_start(bq,false);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to start ADC:%d\n", __func__, ret);
+	if (bq->monitor_active) {
+		bq->monitor_active = false;
+		bq2589x_adc_put(bq);
 	}
-
-	return ret;
 }
 
-
-static ssize_t bq2589x_show_registers(struct device *dev,
-				struct device_attribute *attr, char *buf)
+/*
+ * Legacy entry points, applied to every probed slave. They only queue the
+ * transition so the caller's notifier chain is not held up by bus traffic.
+ */
+void bq2589x_adapter_in_handler(void)
 {
-	u8 addr;
-	u8 val;
-	u8 tmpbuf[300];
-	int len;
-	int idx = 0;
-	int ret ;
-
-	idx = snprintf(buf, PAGE_SIZE, "%s:\n", "Charger");
-	for (addr = 0x0; addr <= 0x14; addr++) {
-		ret = bq2589x_read_byte(g_bq, &val, addr);
-		if (ret == 0) {
-			len = snprintf(tmpbuf, PAGE_SIZE - idx,"Reg[0x%.2x] = 0x%.2x\n", addr, val);
-			memcpy(&buf[idx], tmpbuf, len);
-			idx += len;
-		}
-	}
+	struct bq2589x *bq;
 
-	return idx;
+	mutex_lock(&bq2589x_list_lock);
+	if (list_empty(&bq2589x_list))
+		printk(KERN_ERR "BQ25898S driver not loaded!");
+	list_for_each_entry(bq, &bq2589x_list, list)
+		bq2589x_adapter_notify(bq, true, NULL, NULL);
+	mutex_unlock(&bq2589x_list_lock);
 }
+EXPORT_SYMBOL_GPL(bq2589x_adapter_in_handler);
 
+void bq2589x_adapter_out_handler(void)
+{
+	struct bq2589x *bq;
 
-static DEVICE_ATTR(registers, S_IRUGO, bq2589x_show_registers, NULL);
-
-static struct attribute *bq2589x_attributes[] = {
-	&dev_attr_registers.attr,
-	NULL,
-};
+	mutex_lock(&bq2589x_list_lock);
+	if (list_empty(&bq2589x_list))
+		printk(KERN_ERR "BQ25898S driver not loaded!");
+	list_for_each_entry(bq, &bq2589x_list, list)
+		bq2589x_adapter_notify(bq, false, NULL, NULL);
+	mutex_unlock(&bq2589x_list_lock);
+}
+EXPORT_SYMBOL_GPL(bq2589x_adapter_out_handler);
 
-static const struct attribute_group bq2589x_attr_group = {
-	.attrs = bq2589x_attributes,
-};
+static irqreturn_t bq2589x_charger_interrupt(int irq, void *data)
+{
+	struct bq2589x *bq = data;
 
+	/* the line stays masked until the thread is done (IRQF_ONESHOT) */
+	bq->irq_stamp = ktime_get();
+	return IRQ_WAKE_THREAD;
+}
 
-static int bq2589x_parse_dt(struct device *dev, struct bq2589x *bq)
+/*
+ * Read STATUS/FAULT and stop a finished charge right here, so neither waits
+ * behind adapter handling on the state machine queue; everything else is
+ * left to the state machine.
+ */
+static irqreturn_t bq2589x_charger_irq_thread(int irq, void *data)
 {
+	struct bq2589x *bq = data;
+	ktime_t start;
+	u8 buf[2];
+	u8 charge_status;
 	int ret;
-	struct device_node *np = dev->of_node;
 
-	bq->cfg.enable_auto_dpdm = of_property_read_bool(np, "ti,bq2589x,enable-auto-dpdm");
-	bq->cfg.enable_term = of_property_read_bool(np, "ti,bq2589x,enable-termination");
-	bq->cfg.use_absolute_vindpm = of_property_read_bool(np, "ti,bq2589x,use-absolute-vindpm");
+	start = bq2589x_op_begin(bq, BQ2589X_OP_IRQ);
 
-	ret = of_property_read_u32(np, "ti,bq2589x,charge-voltage",&bq->cfg.charge_voltage);
+	/* STATUS and FAULT are adjacent, fetch both in one transaction */
+	ret = bq2589x_read_block(bq, BQ25898S_REG_0B, buf, 2);
 	if (ret)
-		return ret;
+		goto out;
 
-	ret = of_property_read_u32(np, "ti,bq2589x,charge-current",&bq->cfg.charge_current);
-	if (ret)
-		return ret;
+	if (buf[1] & BQ25898S_FAULT_WDT_MASK) {
+		/* control registers are back to their defaults */
+		bq2589x_cache_invalidate(bq);
+	}
 
-	ret = of_property_read_u32(np, "ti,bq2589x,term-current",&bq->cfg.term_current);
-	if (ret)
-		return ret;
+	charge_status = (buf[0] & BQ25898S_CHRG_STAT_MASK) >> BQ25898S_CHRG_STAT_SHIFT;
+	if (charge_status == BQ25898S_CHRG_STAT_CHGDONE &&
+			bq2589x_state_charging(READ_ONCE(bq->state)))
+		bq2589x_disable_charger(bq);
 
-	ret = of_property_read_u32(np, "ti,bq2589x,input-current-limit",&bq->cfg.iindpm_threshold);
-	if (ret)
-		return ret;
+	if (bq2589x_publish_status(bq, buf[0], buf[1]))
+		power_supply_changed(&bq->psy);
 
-	ret = of_property_read_u32(np, "ti,bq2589x,input-voltage-limit",&bq->cfg.vindpm_threshold);
-	if (ret)
-		return ret;
-	return 0;
+	bq2589x_post_status(bq, buf[0], buf[1]);
+out:
+	bq2589x_irq_account(bq);
+	bq2589x_op_end(bq, BQ2589X_OP_IRQ, start);
+	return IRQ_HANDLED;
 }
 
-static int bq2589x_detect_device(struct bq2589x *bq)
-{
-	int ret;
-	u8 data;
 
-	ret = bq2589x_read_byte(bq, &data, BQ25898S_REG_14);
-	if (ret == 0) {
-		bq->part_no = (data & BQ25898S_PN_MASK) >> BQ25898S_PN_SHIFT;
-		bq->revision = (data & BQ25898S_DEV_REV_MASK) >> BQ25898S_DEV_REV_SHIFT;
+static int bq2589x_xfer_stats_show(struct seq_file *m, void *unused)
+{
+	struct bq2589x *bq = m->private;
+	struct bq2589x_xfer_stats *st = &bq->xfer_stats;
+	int i;
+
+	mutex_lock(&bq->i2c_lock);
+	seq_printf(m, "transactions: %llu\nbytes: %llu\ntotal_ns: %llu\nmax_ns: %llu\n",
+			st->xfers, st->bytes, st->total_ns, st->max_ns);
+	seq_printf(m, "nak: %u\ntimeout: %u\narbitration_lost: %u\nother_errors: %u\n",
+			st->err_nak, st->err_timeout, st->err_arb, st->err_other);
+	seq_printf(m, "retries: %u\nrecovered: %u\nbus_recoveries: %u\nbus_recovery_failed: %u\n",
+			st->retries, st->recovered, st->recoveries, st->recovery_failed);
+	seq_puts(m, "reg       reads     writes     errors\n");
+	for (i = 0; i < BQ25898S_REG_NUM; i++) {
+		if (!st->reads[i] && !st->writes[i] && !st->errors[i])
+			continue;
+		seq_printf(m, "0x%.2x %10u %10u %10u\n", i,
+				st->reads[i], st->writes[i], st->errors[i]);
 	}
+	mutex_unlock(&bq->i2c_lock);
 
-	return ret;
+	return 0;
 }
 
-static int bq2589x_read_batt_rsoc(struct bq2589x *bq)
+static int bq2589x_xfer_stats_open(struct inode *inode, struct file *file)
 {
-	union power_supply_propval ret = {0,};
-
-	if (!bq->batt_psy) 
-		bq->batt_psy = power_supply_get_by_name("battery");
-
-	if (bq->batt_psy) {
-		bq->batt_psy->get_property(bq->batt_psy,POWER_SUPPLY_PROP_CAPACITY,&ret);
-		return ret.intval;
-	} 
-	else {
-		return 50;
-	}
+	return single_open(file, bq2589x_xfer_stats_show, inode->i_private);
 }
 
+static const struct file_operations bq2589x_xfer_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq2589x_xfer_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-static int bq2589x_adjust_absolute_vindpm(struct bq2589x *bq)
+static int bq2589x_xfer_latency_show(struct seq_file *m, void *unused)
 {
-	u16 vbus_volt;
-	u16 vindpm_volt;
-	int ret;
+	struct bq2589x *bq = m->private;
+	u32 *hist = bq->xfer_stats.hist;
+	int i;
 
-	vbus_volt = bq2589x_adc_read_vbus_volt(bq);
-	if (vbus_volt < 0){
-		dev_err(bq->dev, "%s:Failed to read vbus voltage:%d\n", __func__, ret);
-		return ret;
-	}
-	if (vbus_volt < 6000)
-		vindpm_volt = vbus_volt - 600;
-	else
-		vindpm_volt = vbus_volt - 1200;
-	ret = bq2589x_set_input_volt_limit(bq, vindpm_volt);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Set absolute vindpm threshold %d Failed:%d\n", __func__, vindpm_volt, ret);
-		return ret;
-	}
-	else
-		dev_info(bq->dev, "%s:Set absolute vindpm threshold %d successfully\n", __func__, vindpm_volt);
+	mutex_lock(&bq->i2c_lock);
+	seq_printf(m, "       <1 us: %u\n", hist[0]);
+	for (i = 1; i < BQ2589X_LAT_BUCKETS - 1; i++)
+		seq_printf(m, "%5lu-%5lu us: %u\n", BIT(i - 1), BIT(i) - 1, hist[i]);
+	seq_printf(m, "   >=%5lu us: %u\n", BIT(i - 1), hist[i]);
+	mutex_unlock(&bq->i2c_lock);
 
 	return 0;
 }
 
-
-int bq2589x_set_charge_profile(struct bq2589x *bq)
+static int bq2589x_xfer_latency_open(struct inode *inode, struct file *file)
 {
-	int ret;
-	
-	ret = bq2589x_set_chargevoltage(bq, bq->cfg.charge_voltage);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to set charge voltage:%d\n", __func__, ret);
-		return ret;
-	}
+	return single_open(file, bq2589x_xfer_latency_show, inode->i_private);
+}
 
-	ret = bq2589x_set_chargecurrent(bq, bq->cfg.charge_current);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to set charge current:%d\n", __func__, ret);
-		return ret;
-	}
+static const struct file_operations bq2589x_xfer_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq2589x_xfer_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	ret = bq2589x_set_term_current(bq, bq->cfg.term_current);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to set termination current:%d\n", __func__, ret);
-		return ret;
-	}
+static const char * const bq2589x_op_names[] = {
+	[BQ2589X_OP_PROBE]		= "probe",
+	[BQ2589X_OP_ADAPTER_IN]		= "adapter_in",
+	[BQ2589X_OP_ADAPTER_OUT]	= "adapter_out",
+	[BQ2589X_OP_MONITOR]		= "monitor",
+	[BQ2589X_OP_IRQ]		= "irq",
+	[BQ2589X_OP_DUMP]		= "dump",
+};
 
-	ret = bq2589x_set_input_current_limit(bq, bq->cfg.iindpm_threshold);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to set input current limit:%d\n", __func__, ret);
-		return ret;
+/* totals since probe, except max_us which is the slowest single run */
+static int bq2589x_op_stats_show(struct seq_file *m, void *unused)
+{
+	struct bq2589x *bq = m->private;
+	struct bq2589x_op_stats *st;
+	int i;
+
+	mutex_lock(&bq->i2c_lock);
+	seq_puts(m, "operation        count      xfers      bytes     bus_us    wall_us     max_us\n");
+	for (i = 0; i < BQ2589X_OP_NUM; i++) {
+		st = &bq->op_stats[i];
+		seq_printf(m, "%-11s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+				bq2589x_op_names[i], st->count, st->xfers, st->bytes,
+				div_u64(st->bus_ns, 1000), div_u64(st->wall_ns, 1000),
+				div_u64(st->max_ns, 1000));
 	}
+	mutex_unlock(&bq->i2c_lock);
 
-	return bq2589x_adjust_absolute_vindpm(bq);
-	
+	return 0;
+}
 
+static int bq2589x_op_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bq2589x_op_stats_show, inode->i_private);
 }
 
+static const struct file_operations bq2589x_op_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq2589x_op_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-void bq2589x_adapter_in_handler(void)
+static int bq2589x_session_show(struct seq_file *m, void *unused)
 {
-	struct bq2589x *bq = g_bq;
-	int ret;
-	int vbat;
-
-	if (!bq) {
-		printk(KERN_ERR "BQ25898S driver not loaded!");
-		return;
-	}
+	struct bq2589x *bq = m->private;
+	struct bq2589x_session ss;
 
-	ret = bq2589x_set_charge_profile(bq);
-	if (ret) 
-		return;
+	mutex_lock(&bq->session_lock);
+	ss = bq->session;
+	mutex_unlock(&bq->session_lock);
 
-	vbat = bq2589x_adc_read_battery_volt(bq);
-	if (vbat < 0){
-		dev_err(bq->dev, "Failed to read battery voltage");
-		return;
-	}
-	else if (vbat < 3500){
-		bq->prechg = true;
-		schedule_delayed_work(&bq->monitor_work, 10 * HZ);
-		return;
-	}
-	
-	/* check if battery is near full, if so, no need to turn on slave charge */
-	bq->rsoc = bq2589x_read_batt_rsoc(bq);	
-	if (bq->rsoc > 95 ) {
-		dev_info(bq->dev, "%s:RSOC=%d, no need start slavce charger\n", __func__, bq->rsoc);
-		return;			
+	if (!ktime_to_ns(ss.start)) {
+		seq_puts(m, "no session yet\n");
+		return 0;
 	}
 
-	ret = bq2589x_enable_charger(bq);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to enable charging:%d\n", __func__, ret);
-		return ;
-	}
-	else {
-		dev_info(bq->dev, "%s:slave charge start charging\n", __func__);
-	}
-		
-	ret = bq2589x_set_watchdog_timer(bq, 40);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to enable watchdog timer:%d\n", __func__, ret);
-	}
+	seq_printf(m, "state: %s\n", ss.active ? "charging" : "finished");
+	/* up to the last sample of a running session, or to the removal */
+	seq_printf(m, "duration_ms: %lld\n", ktime_to_ms(ktime_sub(ss.last, ss.start)));
+	seq_printf(m, "time_to_full_ms: %lld\n", ss.time_to_full);
+	seq_printf(m, "vbat_start_mv: %d\n", ss.vbat_start);
+	seq_printf(m, "charge_mah: %llu\n", div_u64(ss.charge, 3600000));
+	seq_printf(m, "ichg_max_ma: %d\n", ss.ichg_max);
+	if (ss.ts_min != INT_MAX)
+		seq_printf(m, "ts_min: %d.%03d%%\n", ss.ts_min / 1000, ss.ts_min % 1000);
+	seq_printf(m, "vindpm_events: %u\niindpm_events: %u\n", ss.vdpm_events, ss.idpm_events);
+	seq_printf(m, "thermal_events: %u\nfaults: %u\n", ss.thermal_events, ss.faults);
 
-	schedule_delayed_work(&bq->monitor_work, 10 * HZ);
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_adapter_in_handler);
 
-void bq2589x_adapter_out_handler(void)
+static int bq2589x_session_open(struct inode *inode, struct file *file)
 {
-	struct bq2589x *bq = g_bq;
-	int ret;
-
-	if (!bq) {
-		printk(KERN_ERR "BQ25898S driver not loaded!");
-		return;
-	}
+	return single_open(file, bq2589x_session_show, inode->i_private);
+}
 
-	ret = bq2589x_disable_charger(bq);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to disable charger:%d\n", __func__, ret);
-	}
-	else {
-		dev_info(bq->dev, "%s:slave charge stopped\n", __func__);
-	}
+static const struct file_operations bq2589x_session_fops = {
+	.owner		= THIS_MODULE,
+	.open		= bq2589x_session_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	ret = bq2589x_disable_watchdog_timer(bq);
-	if (ret < 0) {
-		dev_err(bq->dev, "%s:Failed to disable watchdog timer:%d\n", __func__, ret);
-	}
+/* adapter trigger for setups without a master charger, e.g. the chip model */
+static int bq2589x_adapter_get(void *data, u64 *val)
+{
+	struct bq2589x *bq = data;
 
-	cancel_delayed_work_sync(&bq->monitor_work);
+	*val = READ_ONCE(bq->state) != BQ2589X_STATE_ABSENT;
+	return 0;
 }
-EXPORT_SYMBOL_GPL(bq2589x_adapter_out_handler);
 
-static void bq2589x_monitor_workfunc(struct work_struct *work)
+static int bq2589x_adapter_set(void *data, u64 val)
 {
-	struct bq2589x *bq = container_of(work, struct bq2589x, monitor_work.work);
-	u8 status = 0;
-	int ret;
-	int chg_current,vbus_volt,vbat_volt;
-
-	if (bq->prechg) {
-		vbat_volt = bq2589x_adc_read_battery_volt(bq);
-		if (vbat_volt < 0){
-			dev_err(bq->dev, "Failed to read battery voltage");
-			schedule_delayed_work(&bq->monitor_work, 10 * HZ);
-			return;
-		}
-		else if (vbat_volt < 3500) {
-			schedule_delayed_work(&bq->monitor_work, 10 * HZ);
-			return;
-		}
-		else {
-			ret = bq2589x_enable_charger(bq);
-			if (ret < 0) {
-				dev_err(bq->dev, "%s:Failed to enable charging:%d\n", __func__, ret);
-				schedule_delayed_work(&bq->monitor_work, 10 * HZ);
-				return ;
-			}
-			else {
-				dev_info(bq->dev, "%s:slave charge start charging\n", __func__);
-			}
-
-			ret = bq2589x_set_watchdog_timer(bq, 40);
-			if (ret < 0) {
-				dev_err(bq->dev, "%s:Failed to enable watchdog timer:%d\n", __func__, ret);
-			}
-
-			bq->prechg = false;
-			schedule_delayed_work(&bq->monitor_work, 10 * HZ);
-			return;
-		}
-
-	}
-	bq2589x_reset_watchdog_timer(bq);
+	struct bq2589x *bq = data;
 
-	vbus_volt = bq2589x_adc_read_vbus_volt(bq);
-	vbat_volt = bq2589x_adc_read_battery_volt(bq);
-	chg_current = bq2589x_adc_read_charge_current(bq);
+	return val ? bq2589x_adapter_in(bq) : bq2589x_adapter_out(bq);
+}
 
-	dev_info(bq->dev, "%s:vbus volt:%d,vbat volt:%d,charge current:%d\n", __func__,vbus_volt,vbat_volt,chg_current);
+DEFINE_SIMPLE_ATTRIBUTE(bq2589x_adapter_fops, bq2589x_adapter_get,
+			bq2589x_adapter_set, "%llu\n");
 
-	ret = bq2589x_read_byte(bq, &status, BQ25898S_REG_13);
-	if (ret == 0 && (status & BQ25898S_VDPM_STAT_MASK))
-		dev_info(bq->dev, "%s:VINDPM occurred\n", __func__);
-	if (ret == 0 && (status & BQ25898S_IDPM_STAT_MASK))
-		dev_info(bq->dev, "%s:IINDPM occurred\n", __func__);
+/* debugfs is a diagnostic aid only, failing to create it is not fatal */
+static void bq2589x_debugfs_init(struct bq2589x *bq)
+{
+	bq->debugfs = debugfs_create_dir(bq->psy.name, NULL);
+	if (IS_ERR_OR_NULL(bq->debugfs)) {
+		bq->debugfs = NULL;
+		return;
+	}
 
-	schedule_delayed_work(&bq->monitor_work, 10 * HZ);
+	debugfs_create_file("xfer_stats", S_IRUGO, bq->debugfs, bq, &bq2589x_xfer_stats_fops);
+	debugfs_create_file("xfer_latency", S_IRUGO, bq->debugfs, bq, &bq2589x_xfer_latency_fops);
+	debugfs_create_file("op_stats", S_IRUGO, bq->debugfs, bq, &bq2589x_op_stats_fops);
+	debugfs_create_file("charge_session", S_IRUGO, bq->debugfs, bq, &bq2589x_session_fops);
+	debugfs_create_file("adapter", S_IRUGO | S_IWUSR, bq->debugfs, bq, &bq2589x_adapter_fops);
 }
 
+/* used for DT nodes that give neither an interrupt nor ti,bq2589x,irq-gpio */
+#define GPIO_IRQ    80
 
-
-static void bq2589x_charger_irq_workfunc(struct work_struct *work)
+static int bq2589x_setup_irq_gpio(struct bq2589x *bq)
 {
-	struct bq2589x *bq = container_of(work, struct bq2589x, irq_work);
-	u8 status = 0;
-	u8 fault = 0;
-	u8 charge_status = 0;
+	struct device_node *np = bq->dev->of_node;
+	int irqn;
 	int ret;
 
-	msleep(5);
+	bq->irq_gpio = -1;
+	if (bq->client->irq > 0)
+		return 0;
 
-	/* Read STATUS and FAULT registers */
-	ret = bq2589x_read_byte(bq, &status, BQ25898S_REG_0B);
-	if (ret)
-		return;
+	/* e.g. instantiated from userspace on i2c-stub, status is polled */
+	if (!np) {
+		dev_info(bq->dev, "%s:no interrupt, polling status\n", __func__);
+		return 0;
+	}
 
-	ret = bq2589x_read_byte(bq, &fault, BQ25898S_REG_0C);
-	if (ret)
-		return;
-	
-	charge_status = (status & BQ25898S_CHRG_STAT_MASK) >> BQ25898S_CHRG_STAT_SHIFT;
-	if (charge_status == BQ25898S_CHRG_STAT_IDLE)
-		dev_info(bq->dev, "%s:not charging\n", __func__);
-	else if (charge_status == BQ25898S_CHRG_STAT_PRECHG)
-		dev_info(bq->dev, "%s:precharging\n", __func__);
-	else if (charge_status == BQ25898S_CHRG_STAT_FASTCHG)
-		dev_info(bq->dev, "%s:fast charging\n", __func__);
-	else if (charge_status == BQ25898S_CHRG_STAT_CHGDONE){
-		dev_info(bq->dev, "%s:charge done!\n", __func__);
-		bq2589x_disable_charger(bq);
+	if (of_find_property(np, "ti,bq2589x,irq-gpio", NULL)) {
+		ret = of_get_named_gpio(np, "ti,bq2589x,irq-gpio", 0);
+		if (ret < 0) {
+			dev_err(bq->dev, "%s: invalid irq gpio:%d\n", __func__, ret);
+			return ret;
+		}
+	} else {
+		ret = GPIO_IRQ;
 	}
-	
-	if (fault)
-		dev_info(bq->dev, "%s:charge fault:%02x\n", __func__,fault);
-}
 
+	bq->irq_gpio = ret;
+	ret = gpio_request(bq->irq_gpio, "bq2589x irq pin");
+	if (ret) {
+		dev_err(bq->dev, "%s: %d gpio request failed\n", __func__, bq->irq_gpio);
+		bq->irq_gpio = -1;
+		return ret;
+	}
+	gpio_direction_input(bq->irq_gpio);
 
-static irqreturn_t bq2589x_charger_interrupt(int irq, void *data)
-{
-	struct bq2589x *bq = data;
+	irqn = gpio_to_irq(bq->irq_gpio);
+	if (irqn < 0) {
+		dev_err(bq->dev, "%s:%d gpio_to_irq failed\n", __func__, irqn);
+		gpio_free(bq->irq_gpio);
+		bq->irq_gpio = -1;
+		return irqn;
+	}
+	bq->client->irq = irqn;
 
-	schedule_work(&bq->irq_work);
-	return IRQ_HANDLED;
+	return 0;
 }
 
-
-#define GPIO_IRQ    80
 static int bq2589x_charger_probe(struct i2c_client *client,
 			   const struct i2c_device_id *id)
 {
 	struct bq2589x *bq;
-	int irqn;
+	ktime_t start;
+	u8 status;
+	int i;
 
 	int ret;
 
-	bq = devm_kzalloc(&client->dev, sizeof(struct bq2589x), GFP_KERNEL);
+	bq = kzalloc(sizeof(struct bq2589x), GFP_KERNEL);
 	if (!bq) {
 		dev_err(&client->dev, "%s: out of memory\n", __func__);
 		return -ENOMEM;
 	}
 
-	bq->dev = &client->dev;
+	kref_init(&bq->ref);
+	bq->dev = get_device(&client->dev);
 	bq->client = client;
+	bq->block_io = i2c_check_functionality(client->adapter, I2C_FUNC_SMBUS_I2C_BLOCK);
+	mutex_init(&bq->i2c_lock);
+	mutex_init(&bq->adc_lock);
+	mutex_init(&bq->session_lock);
+	spin_lock_init(&bq->req_lock);
+	seqlock_init(&bq->tlm_lock);
+	INIT_LIST_HEAD(&bq->list);
 	i2c_set_clientdata(client, bq);
 
+	start = bq2589x_op_begin(bq, BQ2589X_OP_PROBE);
+
 	ret = bq2589x_detect_device(bq);
 	if (!ret && bq->part_no == BQ25898S) {
 		dev_info(bq->dev, "%s: charger device bq25898S detected, revision:%d\n", __func__, bq->revision);
@@ -884,11 +3723,23 @@ static int bq2589x_charger_probe(struct i2c_client *client,
 	}
 
 	bq->batt_psy = power_supply_get_by_name("battery");
-
-	g_bq = bq;
-
+	bq->rsoc = -1;
+	bq->req_total = -1;
+	for (i = 0; i < BQ2589X_ICHG_VOTERS; i++)
+		bq->ichg_votes[i] = -1;
+	bq->thermal_iinlim = -1;
+	bq->jeita_zone = -1;
+	bq->jeita_vreg = -1;
+
+	bq2589x_default_config(bq);
 	if (client->dev.of_node)
 		bq2589x_parse_dt(&client->dev, bq);
+	else if (dev_get_platdata(&client->dev))
+		bq2589x_parse_pdata(bq, dev_get_platdata(&client->dev));
+	else
+		dev_info(bq->dev, "%s:no DT node or platform data, using chip defaults\n", __func__);
+	bq2589x_apply_config(bq);
+	bq2589x_aicl_reset(bq);
 
 	ret = bq2589x_init_device(bq);
 	if (ret) {
@@ -896,65 +3747,146 @@ static int bq2589x_charger_probe(struct i2c_client *client,
 		goto err_0;
 	}
 
-	ret = gpio_request(GPIO_IRQ, "bq2589x irq pin");
-	if (ret) {
-		dev_err(bq->dev, "%s: %d gpio request failed\n", __func__, GPIO_IRQ);
+	/* later status changes are published by the interrupt thread */
+	ret = bq2589x_read_byte(bq, &status, BQ25898S_REG_0B);
+	if (ret)
 		goto err_0;
-	}
-	gpio_direction_input(GPIO_IRQ);
+	bq2589x_publish_status(bq, status, 0);
 
-	irqn = gpio_to_irq(GPIO_IRQ);
-	if (irqn < 0) {
-		dev_err(bq->dev, "%s:%d gpio_to_irq failed\n", __func__, irqn);
-		ret = irqn;
-		goto err_1;
-	}
-	client->irq = irqn;
+	ret = bq2589x_setup_irq_gpio(bq);
+	if (ret)
+		goto err_0;
 
 
-	INIT_WORK(&bq->irq_work, bq2589x_charger_irq_workfunc);
+	/* one ordered queue serializes every state machine step */
+	bq->wq = alloc_ordered_workqueue("%s", WQ_HIGHPRI | WQ_FREEZABLE, dev_name(bq->dev));
+	if (!bq->wq) {
+		ret = -ENOMEM;
+		goto err_gpio;
+	}
+	bq->state = BQ2589X_STATE_ABSENT;
+	INIT_WORK(&bq->event_work, bq2589x_event_workfunc);
+	/* don't wake an idle CPU just to poll, unless the watchdog needs it */
 	INIT_DELAYED_WORK(&bq->monitor_work, bq2589x_monitor_workfunc);
+	INIT_DEFERRABLE_WORK(&bq->monitor_idle_work, bq2589x_monitor_idle_workfunc);
 
 
 	ret = sysfs_create_group(&bq->dev->kobj, &bq2589x_attr_group);
 	if (ret) {
 		dev_err(bq->dev, "failed to register sysfs. err: %d\n", ret);
-		goto err_irq;
+		goto err_wq;
 	}
 
-	ret = request_irq(client->irq, bq2589x_charger_interrupt, IRQF_TRIGGER_FALLING | IRQF_ONESHOT, "bq2589x_charger1_irq", bq);
+	ret = bq2589x_psy_register(bq);
 	if (ret) {
-		dev_err(bq->dev, "%s:Request IRQ %d failed: %d\n", __func__, client->irq, ret);
-		goto err_irq;
-	} else {
-		dev_info(bq->dev, "%s:irq = %d\n", __func__, client->irq);
+		dev_err(bq->dev, "failed to register power supply. err: %d\n", ret);
+		goto err_sysfs;
+	}
+
+	bq2589x_debugfs_init(bq);
+
+	/* not fatal, the charger works without thermal management */
+	if (bq->cfg.thermal_levels) {
+		bq->cdev = thermal_of_cooling_device_register(bq->dev->of_node,
+				(char *)bq->psy.name, bq, &bq2589x_cdev_ops);
+		if (IS_ERR(bq->cdev)) {
+			dev_warn(bq->dev, "failed to register cooling device. err: %ld\n",
+					PTR_ERR(bq->cdev));
+			bq->cdev = NULL;
+		}
 	}
 
+	bq->batt_nb.notifier_call = bq2589x_batt_notifier_call;
+	ret = power_supply_reg_notifier(&bq->batt_nb);
+	if (ret) {
+		dev_err(bq->dev, "failed to register battery notifier. err: %d\n", ret);
+		goto err_cdev;
+	}
+
+	if (client->irq > 0) {
+		ret = request_threaded_irq(client->irq, bq2589x_charger_interrupt,
+					bq2589x_charger_irq_thread,
+					IRQF_TRIGGER_FALLING | IRQF_ONESHOT, dev_name(bq->dev), bq);
+		if (ret) {
+			dev_err(bq->dev, "%s:Request IRQ %d failed: %d\n", __func__, client->irq, ret);
+			goto err_nb;
+		} else {
+			dev_info(bq->dev, "%s:irq = %d\n", __func__, client->irq);
+		}
+	}
+
+	mutex_lock(&bq2589x_list_lock);
+	list_add_tail(&bq->list, &bq2589x_list);
+	mutex_unlock(&bq2589x_list_lock);
+
+	bq2589x_op_end(bq, BQ2589X_OP_PROBE, start);
 	return 0;
 
-err_irq:
-	cancel_work_sync(&bq->irq_work);
-	cancel_delayed_work_sync(&bq->monitor_work);
-err_1:
-	gpio_free(GPIO_IRQ);
+err_nb:
+	power_supply_unreg_notifier(&bq->batt_nb);
+err_cdev:
+	if (bq->cdev)
+		thermal_cooling_device_unregister(bq->cdev);
+	debugfs_remove_recursive(bq->debugfs);
+	bq2589x_sm_stop(bq);
+	power_supply_unregister(&bq->psy);
+err_sysfs:
+	sysfs_remove_group(&bq->dev->kobj, &bq2589x_attr_group);
+err_wq:
+	destroy_workqueue(bq->wq);
+err_gpio:
+	if (bq->irq_gpio >= 0)
+		gpio_free(bq->irq_gpio);
 err_0:
-	g_bq = NULL;
+	bq2589x_put(bq);
 	return ret;
 }
 
+/* undoes everything probe set up, in reverse */
+static int bq2589x_charger_remove(struct i2c_client *client)
+{
+	struct bq2589x *bq = i2c_get_clientdata(client);
+
+	/* no more legacy handler calls, interrupts or battery/cooling events */
+	mutex_lock(&bq2589x_list_lock);
+	list_del(&bq->list);
+	mutex_unlock(&bq2589x_list_lock);
+
+	if (bq->client->irq > 0)
+		free_irq(bq->client->irq, bq);
+	power_supply_unreg_notifier(&bq->batt_nb);
+	if (bq->cdev)
+		thermal_cooling_device_unregister(bq->cdev);
+	/* and no more debugfs or sysfs writes queueing work */
+	debugfs_remove_recursive(bq->debugfs);
+	sysfs_remove_group(&bq->dev->kobj, &bq2589x_attr_group);
+
+	bq2589x_sm_stop(bq);
+	/* nobody resets the watchdog from now on, leave the slave switched off */
+	bq2589x_write_state_regs(bq, BQ2589X_STATE_ABSENT);
+
+	power_supply_unregister(&bq->psy);
+	destroy_workqueue(bq->wq);
+
+	if (bq->irq_gpio >= 0)
+		gpio_free(bq->irq_gpio);
+
+	/* freed here unless a bq2589x_find_by_node() user still holds it */
+	bq2589x_put(bq);
+
+	return 0;
+}
+
+/* only quiesce the bus, the instance stays registered until remove */
 static void bq2589x_charger_shutdown(struct i2c_client *client)
 {
 	struct bq2589x *bq = i2c_get_clientdata(client);
 
 	dev_info(bq->dev, "%s: shutdown\n", __func__);
 
-	sysfs_remove_group(&bq->dev->kobj, &bq2589x_attr_group);
-	cancel_work_sync(&bq->irq_work);
-	cancel_delayed_work_sync(&bq->monitor_work);
-
-	free_irq(bq->client->irq, bq);
-	gpio_free(GPIO_IRQ);
-	g_bq = NULL;
+	if (bq->client->irq > 0)
+		disable_irq(bq->client->irq);
+	bq2589x_sm_stop(bq);
 }
 
 static struct of_device_id bq2589x_charger_match_table[] = {
@@ -978,6 +3910,7 @@ static struct i2c_driver bq2589x_charger_driver = {
 	.id_table	= bq2589x_charger_id,
 
 	.probe		= bq2589x_charger_probe,
+	.remove		= bq2589x_charger_remove,
 	.shutdown   = bq2589x_charger_shutdown,
 };
 
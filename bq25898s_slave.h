@@ -0,0 +1,136 @@
+#ifndef __BQ25898S_SLAVE_HEADER__
+#define __BQ25898S_SLAVE_HEADER__
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+
+struct bq2589x;
+struct device_node;
+
+/*
+ * Configuration for a slave without a DT node, e.g. from a board file or
+ * the chip model, in the units of the ti,bq2589x,* properties it stands
+ * in for. Zero keeps the chip's power-on value; the tables are the DT
+ * tables flattened, with their number of entries.
+ */
+struct bq2589x_platform_data {
+	int	charge_voltage;		/* mV */
+	int	charge_current;		/* mA */
+	int	term_current;		/* mA */
+	int	input_current_limit;	/* mA */
+	int	input_voltage_limit;	/* mV */
+	bool	enable_term;
+	bool	enable_auto_dpdm;
+	bool	use_absolute_vindpm;
+	int	aicl_max_current;	/* mA, 0 keeps the input limit static */
+	int	current_share;		/* % of a shared total, 0 for 50 */
+
+	const u32	*step_charge;	/* <vbat-mV ichg-mA> */
+	int		step_num;
+	const u32	*thermal_mitigation;	/* <ichg-mA iinlim-mA> */
+	int		thermal_num;
+	const u32	*jeita_zones;	/* <ts-min ts-max vreg-mV ichg-mA> */
+	int		jeita_num;
+};
+
+/* decoded image of the ADC result registers 0x0E-0x13 */
+struct bq2589x_adc_data {
+	int	vbat;		/* mV */
+	int	vsys;		/* mV */
+	int	ts_pct;		/* TS voltage in 0.001% of REGN */
+	int	vbus;		/* mV */
+	int	ichg;		/* mA */
+	int	idpm_lim;	/* mA */
+	bool	therm_stat;
+	bool	vbus_gd;
+	bool	vdpm;
+	bool	idpm;
+};
+
+/* last published state of a slave, see bq2589x_get_telemetry() */
+struct bq2589x_telemetry {
+	struct bq2589x_adc_data adc;
+	ktime_t	timestamp;	/* ktime_get() when adc was read */
+	u8	status;		/* REG_0B */
+	u8	fault;		/* REG_0C as read by the last interrupt */
+	bool	valid;
+};
+
+/* register fields handled by the table driven field engine */
+enum bq2589x_field_id {
+	BQ2589X_F_EN_HIZ,		/* REG_00 */
+	BQ2589X_F_IINLIM,		/* mA */
+	BQ2589X_F_VINDPM_OS,		/* REG_01 */
+	BQ2589X_F_CONV_RATE,		/* REG_02 */
+	BQ2589X_F_AUTO_DPDM_EN,
+	BQ2589X_F_CHG_CONFIG,		/* REG_03 */
+	BQ2589X_F_ICHG,			/* REG_04, mA */
+	BQ2589X_F_IPRECHG,		/* REG_05, mA */
+	BQ2589X_F_ITERM,		/* mA */
+	BQ2589X_F_VREG,			/* REG_06, mV */
+	BQ2589X_F_BATLOWV,
+	BQ2589X_F_VRECHG,
+	BQ2589X_F_EN_TERM,		/* REG_07 */
+	BQ2589X_F_WDT,
+	BQ2589X_F_EN_TIMER,
+	BQ2589X_F_CHG_TIMER,
+	BQ2589X_F_BAT_COMP,		/* REG_08, mOhm */
+	BQ2589X_F_VCLAMP,		/* mV */
+	BQ2589X_F_TREG,
+	BQ2589X_F_TMR2X_EN,		/* REG_09 */
+	BQ2589X_F_FORCE_VINDPM,		/* REG_0D */
+	BQ2589X_F_VINDPM,		/* mV */
+	BQ2589X_F_THERM_STAT,		/* REG_0E, read only from here on */
+	BQ2589X_F_BATV,			/* mV */
+	BQ2589X_F_SYSV,			/* REG_0F, mV */
+	BQ2589X_F_TSPCT,		/* REG_10, 0.001% */
+	BQ2589X_F_VBUS_GD,		/* REG_11 */
+	BQ2589X_F_VBUSV,		/* mV */
+	BQ2589X_F_ICHGR,		/* REG_12, mA */
+	BQ2589X_F_VDPM_STAT,		/* REG_13 */
+	BQ2589X_F_IDPM_STAT,
+	BQ2589X_F_IDPM_LIM,		/* mA */
+	BQ2589X_F_MAX_FIELDS,
+};
+
+struct bq2589x_field_val {
+	enum bq2589x_field_id	id;
+	int			val;
+};
+
+int bq2589x_field_read(struct bq2589x *bq, enum bq2589x_field_id id, int *val);
+int bq2589x_field_write(struct bq2589x *bq, enum bq2589x_field_id id, int val);
+int bq2589x_fields_write(struct bq2589x *bq, const struct bq2589x_field_val *vals, int num);
+
+int bq2589x_adc_get(struct bq2589x *bq);
+void bq2589x_adc_put(struct bq2589x *bq);
+int bq2589x_read_adc(struct bq2589x *bq, struct bq2589x_adc_data *data);
+void bq2589x_get_telemetry(struct bq2589x *bq, struct bq2589x_telemetry *tlm);
+int bq2589x_get_telemetry_fresh(struct bq2589x *bq, struct bq2589x_telemetry *tlm,
+				unsigned int max_age_ms);
+
+int bq2589x_request_total_current(struct bq2589x *bq, int total_ma);
+int bq2589x_get_current_share(struct bq2589x *bq);
+
+struct bq2589x *bq2589x_find_by_node(struct device_node *np);
+void bq2589x_put(struct bq2589x *bq);
+int bq2589x_adapter_in(struct bq2589x *bq);
+int bq2589x_adapter_out(struct bq2589x *bq);
+
+/*
+ * Completion callback for bq2589x_adapter_notify(). Runs from the driver's
+ * work item with the result of the transition. When a later notification
+ * supersedes this one before it was acted on, or the driver is removed
+ * first, it gets -ECANCELED instead, called directly from that later
+ * bq2589x_adapter_notify() or from remove. That may be atomic context, so
+ * the callback must not sleep.
+ */
+typedef void (*bq2589x_adapter_cb_t)(void *data, bool present, int ret);
+
+int bq2589x_adapter_notify(struct bq2589x *bq, bool present,
+			bq2589x_adapter_cb_t cb, void *data);
+
+void bq2589x_adapter_in_handler(void);
+void bq2589x_adapter_out_handler(void);
+
+#endif
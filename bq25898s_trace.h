@@ -0,0 +1,56 @@
+/*
+ * BQ2589x slave charger tracepoints
+ *
+ * The driver Makefile needs "CFLAGS_bq25898s_slave.o := -I$(src)" so that
+ * define_trace.h can find this header.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bq25898s
+
+#if !defined(_BQ25898S_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BQ25898S_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(bq2589x_i2c_xfer,
+
+	TP_PROTO(struct device *dev, u8 reg, u8 len, u8 val, bool write,
+		 s64 duration_ns, int err),
+
+	TP_ARGS(dev, reg, len, val, write, duration_ns, err),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u8, reg)
+		__field(u8, len)
+		__field(u8, val)
+		__field(bool, write)
+		__field(s64, duration_ns)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->val = val;
+		__entry->write = write;
+		__entry->duration_ns = duration_ns;
+		__entry->err = err;
+	),
+
+	TP_printk("%s %s reg=0x%02x len=%u val=0x%02x duration=%lldns err=%d",
+		  __get_str(dev), __entry->write ? "write" : "read",
+		  __entry->reg, __entry->len, __entry->val,
+		  __entry->duration_ns, __entry->err)
+);
+
+#endif /* _BQ25898S_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bq25898s_trace
+#include <trace/define_trace.h>